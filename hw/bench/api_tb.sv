@@ -31,6 +31,21 @@ module api_tb;
     logic wr_valid;
     logic wr_ready;
     logic start;
+    logic active;
+    logic [31:0] crc;
+
+    // Performance counters
+    logic [4:0] perf_sel;
+    logic [31:0] perf_value;
+    logic perf_freeze;
+    logic perf_clear;
+
+    // WRAM dirty pages
+    logic [1:0] dirty_sel;
+    logic [31:0] dirty_value;
+    logic dirty_snap;
+    logic wram_written;
+    logic [6:0] wram_page;
 
     // SDRAM interface
     sdram_bus ram ();
@@ -52,6 +67,17 @@ module api_tb;
         .wr_reg_addr(wr_reg_addr),
         .wr_reg_changed(wr_reg_changed),
         .ev_reg(ev_reg),
+        .perf_sel(perf_sel),
+        .perf_value(perf_value),
+        .perf_freeze(perf_freeze),
+        .perf_clear(perf_clear),
+        .stat_words(),
+        .stat_rx_empty(),
+        .stat_tx_full(),
+        .crc(crc),
+        .dirty_sel(dirty_sel),
+        .dirty_value(dirty_value),
+        .dirty_snap(dirty_snap),
         .ram(ram.controller),
         .rd_data(rd_data),
         .rd_valid(rd_valid),
@@ -59,7 +85,8 @@ module api_tb;
         .wr_data(wr_data),
         .wr_valid(wr_valid),
         .wr_ready(wr_ready),
-        .start(start)
+        .start(start),
+        .active(active)
     );
 
     qspi qspi_inst (
@@ -74,7 +101,30 @@ module api_tb;
         .wr_data(wr_data),
         .wr_valid(wr_valid),
         .wr_ready(wr_ready),
-        .start(start)
+        .start(start),
+        .active(active),
+        .crc(crc)
+    );
+
+    perf #(
+        .COUNTERS(2)
+    ) perf_inst (
+        .clk(clk),
+        .reset(reset),
+        .inc({ram.ack, 1'b1}),
+        .freeze(perf_freeze),
+        .clear(perf_clear),
+        .sel(perf_sel),
+        .value(perf_value)
+    );
+
+    wram_dirty wram_dirty_inst (
+        .clk(clk),
+        .written(wram_written),
+        .page(wram_page),
+        .snap(dirty_snap),
+        .sel(dirty_sel),
+        .value(dirty_value)
     );
 
     W9825G6KH sdram_model (
@@ -118,11 +168,13 @@ module api_tb;
         bus1.req = 0;
         bus1.we = 0;
         bus1.wm = 0;
+        bus1.burst = 0;
         bus1.address = 0;
         bus1.data_write = 0;
         bus2.req = 0;
         bus2.we = 0;
         bus2.wm = 0;
+        bus2.burst = 0;
         bus2.address = 0;
         bus2.data_write = 0;
     end
@@ -244,6 +296,44 @@ module api_tb;
         qspi_ncs = 1;
     endtask
 
+    task mem_cmd(input [7:0] cmd, input [23:0] addr, input [7:0] args[8], input integer n);
+        integer i;
+        $display("Memory command %0d: Addr=%h", cmd, addr);
+        qspi_ncs  = 0;
+        master_we = 1;
+
+        send_byte(cmd);
+        send_byte(addr[23:16]);
+        send_byte(addr[15:8]);
+        send_byte(addr[7:0]);
+
+        for (i = 0; i < n; i++) begin
+            send_byte(args[i]);
+        end
+
+        master_we = 0;
+        qspi_ncs  = 1;
+    endtask
+
+    task wait_mem_idle;
+        logic [31:0] busy;
+        do begin
+            #(CYC * 2);
+            read_reg(24'h000005, busy);
+        end while (busy[0]);
+    endtask
+
+    function automatic logic [31:0] crc32(input logic [7:0] data[], input int repeats);
+        logic [31:0] c = '1;
+        for (int r = 0; r < repeats; r++) begin
+            foreach (data[i]) begin
+                c ^= {24'd0, data[i]};
+                for (int b = 0; b < 8; b++) c = (c >> 1) ^ (32'hEDB88320 & {32{c[0]}});
+            end
+        end
+        return ~c;
+    endfunction
+
     // Test Sequence
     initial begin
         $dumpfile("api_tb.vcd");
@@ -256,6 +346,8 @@ module api_tb;
         qspi_ncs = 1;
         master_we = 0;
         ev_reg = 32'hDEADBEEF;
+        wram_written = 0;
+        wram_page = 0;
 
         #(CYC * 2);
         reset = 0;
@@ -313,6 +405,125 @@ module api_tb;
             end
         end
 
+        #(CYC * 2);
+
+        // 5. Performance counters
+        begin
+            logic [31:0] clocks, clocks_again, acks;
+            write_reg(24'h000003, 32'h1);  // freeze
+            #(CYC * 2);
+            read_reg(24'h000003, clocks);
+            read_reg(24'h000003, clocks_again);
+            read_reg(24'h000103, acks);
+            assert (clocks != 0 && clocks == clocks_again)
+            else $fatal(1, "Frozen clock counter changed: %0d -> %0d", clocks, clocks_again);
+            assert (acks >= 32)
+            else $fatal(1, "SDRAM acks: expected at least 32, got %0d", acks);
+
+            write_reg(24'h000003, 32'h2);  // clear and run
+            #(CYC * 2);
+            read_reg(24'h000103, acks);
+            assert (acks == 0)
+            else $fatal(1, "Cleared ack counter: expected 0, got %0d", acks);
+        end
+
+        #(CYC * 2);
+
+        // 6. CRC32 of memory transfers
+        begin
+            logic [7:0] wdata[32], rdata[32];
+            logic [7:0] bytes[];
+            logic [31:0] value;
+            for (int i = 0; i < 32; i++) wdata[i] = 8'(i * 7);
+            bytes = new[32];
+            foreach (wdata[i]) bytes[i] = wdata[i];
+
+            write_reg(24'h000004, 32'h0);  // reset
+            write_mem(24'h002000, wdata);
+            #(CYC * 2);
+            read_reg(24'h000004, value);
+            assert (value == crc32(bytes, 1))
+            else $fatal(1, "Write CRC: expected %h, got %h", crc32(bytes, 1), value);
+
+            read_mem(24'h002000, rdata);
+            #(CYC * 2);
+            read_reg(24'h000004, value);
+            assert (value == crc32(bytes, 2))
+            else $fatal(1, "Read CRC: expected %h, got %h", crc32(bytes, 2), value);
+        end
+
+        #(CYC * 2);
+
+        // 7. FILL and COPY run inside the FPGA
+        begin
+            logic [7:0] args[8], rdata[32];
+            // 16-bit pattern, the first byte goes to even addresses
+            args = '{8'd32, 8'd0, 8'd0, 8'd0, 8'hA5, 8'h5A, 8'd0, 8'd0};
+            mem_cmd(8'h05, 24'h003000, args, 6);  // CMD_FILL_MEM
+            wait_mem_idle();
+            read_mem(24'h003000, rdata);
+            foreach (rdata[i]) begin
+                assert (rdata[i] == (i % 2 ? 8'h5A : 8'hA5))
+                else $fatal(1, "Fill byte %0d mismatch: Expected %h, got %h", i, i % 2 ? 8'h5A : 8'hA5, rdata[i]);
+            end
+
+            args = '{8'h00, 8'h10, 8'h00, 8'h00, 8'd32, 8'd0, 8'd0, 8'd0};
+            mem_cmd(8'h07, 24'h004000, args, 8);  // CMD_COPY_MEM from 0x001000
+            wait_mem_idle();
+            read_mem(24'h004000, rdata);
+            foreach (rdata[i]) begin
+                assert (rdata[i] == 8'(i))
+                else $fatal(1, "Copy byte %0d mismatch: Expected %h, got %h", i, 8'(i), rdata[i]);
+            end
+        end
+
+        #(CYC * 2);
+
+        // 8. CRC32 of SDRAM contents computed by the FPGA
+        begin
+            logic [7:0] args[8];
+            logic [7:0] bytes[];
+            logic [31:0] value;
+            bytes = new[32];
+            foreach (bytes[i]) bytes[i] = 8'(i * 7);
+
+            write_reg(24'h000006, 32'h0);  // reset
+            args = '{8'd32, 8'd0, 8'd0, 8'd0, 8'd0, 8'd0, 8'd0, 8'd0};
+            mem_cmd(8'h09, 24'h002000, args, 4);  // CMD_CRC_MEM
+            wait_mem_idle();
+            read_reg(24'h000006, value);
+            assert (value == crc32(bytes, 1))
+            else $fatal(1, "Memory CRC: expected %h, got %h", crc32(bytes, 1), value);
+        end
+
+        #(CYC * 2);
+
+        // 9. WRAM dirty pages, one snapshot word per read
+        begin
+            logic [31:0] value;
+            logic [31:0] want[4];
+            int pages[5] = '{3, 40, 70, 96, 127};
+            want = '{32'h0000_0008, 32'h0000_0100, 32'h0000_0040, 32'h8000_0001};
+
+            write_reg(24'h000007, 32'h0);  // drop writes made before the test
+            foreach (pages[i]) begin
+                @(posedge clk);
+                wram_written <= 1;
+                wram_page <= 7'(pages[i]);
+                @(posedge clk);
+                wram_written <= 0;
+            end
+            #(CYC * 2);
+            write_reg(24'h000007, 32'h0);  // snapshot
+            #(CYC * 2);
+            // Back to back, as fpga_api_wram_dirty() reads them
+            for (int i = 0; i < 4; i++) begin
+                read_reg(24'h000007 | 24'(i << 8), value);
+                assert (value == want[i])
+                else $fatal(1, "Dirty word %0d: expected %h, got %h", i, want[i], value);
+            end
+        end
+
         #(CYC * 2);
         $display("Testbench completed");
         $finish;
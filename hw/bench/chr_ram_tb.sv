@@ -0,0 +1,225 @@
+`timescale 1ns / 1ps
+
+module chr_ram_tb;
+    localparam PPU_CYC = 186;  // 5.37MHz PPU clock period
+    localparam TILES = 64;
+
+    // System clock (100MHz)
+    logic clk = 0;
+    always #5 clk <= !clk;
+
+    logic reset;
+
+    // PPU side
+    logic [13:0] ppu_addr;
+    logic [7:0] data_out;
+    logic oe;
+
+    // SDRAM interface
+    sdram_bus bus0 ();
+    sdram_bus bus1 ();
+    sdram_bus bus2 ();
+
+    wire [15:0] sdram_dq;
+    wire [12:0] sdram_addr;
+    wire [ 1:0] sdram_bank;
+    wire [ 3:0] sdram_command;
+    wire [ 1:0] sdram_dqm;
+
+    chr_ram dut (
+        .clk(clk),
+        .ram(bus1.controller),
+        .addr(23'(ppu_addr[12:0])),
+        .ppu_a13(ppu_addr[13]),
+        .data_in(8'h00),
+        .data_out(data_out),
+        .ce(!ppu_addr[13]),
+        .oe(oe),
+        .we(1'b0)
+    );
+
+    W9825G6KH sdram_model (
+        .Dq   (sdram_dq),
+        .Addr (sdram_addr),
+        .Bs   (sdram_bank),
+        .Clk  (clk),
+        .Cke  (1'b1),
+        .Cs_n (sdram_command[3]),
+        .Ras_n(sdram_command[2]),
+        .Cas_n(sdram_command[1]),
+        .We_n (sdram_command[0]),
+        .Dqm  (sdram_dqm)
+    );
+
+    sdram #(
+        .ROW_BITS(13),
+        .COL_BITS(9)
+    ) sdram_inst (
+        .clk(clk),
+        .reset(reset),
+        .ch0(bus0.memory),
+        .ch1(bus1.memory),
+        .ch2(bus2.memory),
+        .refresh(1'b0),
+
+        .sdram_cs  (sdram_command[3]),
+        .sdram_addr(sdram_addr),
+        .sdram_ba  (sdram_bank),
+        .sdram_dq  (sdram_dq),
+        .sdram_ras (sdram_command[2]),
+        .sdram_cas (sdram_command[1]),
+        .sdram_we  (sdram_command[0]),
+        .sdram_dqm (sdram_dqm)
+    );
+
+    // Drive unused buses
+    initial begin
+        bus0.req = 0;
+        bus0.we = 0;
+        bus0.wm = 0;
+        bus0.burst = 0;
+        bus0.address = 0;
+        bus0.data_write = 0;
+        bus2.req = 0;
+        bus2.we = 0;
+        bus2.wm = 0;
+        bus2.burst = 0;
+        bus2.address = 0;
+        bus2.data_write = 0;
+    end
+
+    function automatic logic [15:0] pattern(input logic [21:0] address);
+        return 16'(address * 16'h9E37) ^ 16'h5A5A;
+    endfunction
+
+    function automatic logic [7:0] pattern_byte(input logic [12:0] a);
+        logic [15:0] w = pattern(22'(a[12:1]));
+        return a[0] ? w[15:8] : w[7:0];
+    endfunction
+
+    // Fetch requests and the clocks until their first word reaches data_out
+    int cycle = 0;
+    int req_cycle;
+    int reqs, bursts, worst;
+    always @(posedge clk) begin
+        cycle <= cycle + 1;
+        if (bus1.req) begin
+            req_cycle <= cycle;
+            reqs <= reqs + 1;
+            if (bus1.burst != 0) bursts <= bursts + 1;
+        end
+    end
+
+    always @(negedge clk) begin
+        if (dut.fetching && bus1.ack && dut.ack_cnt == 0) begin
+            if (cycle - req_cycle > worst) worst = cycle - req_cycle;
+            assert (cycle - req_cycle <= sdram_inst.PPU_DEADLINE)
+            else $fatal(1, "PPU deadline missed: %0d > %0d clocks", cycle - req_cycle, sdram_inst.PPU_DEADLINE);
+            assert (data_out == pattern_byte(ppu_addr[12:0]))
+            else $fatal(1, "Ack clock %h: expected %h, got %h", ppu_addr, pattern_byte(ppu_addr[12:0]), data_out);
+        end
+    end
+
+    task automatic write_word(input logic [21:0] address, input logic [15:0] data);
+        bus2.req = 1;
+        bus2.we = 1;
+        bus2.wm = 2'b00;
+        bus2.address = address;
+        bus2.data_write = data;
+        @(posedge clk);
+        bus2.req = 0;
+        @(posedge clk iff bus2.ack);
+    endtask
+
+    // One PPU read: the address is out half a PPU cycle before /RD falls,
+    // the byte is latched when /RD rises a PPU cycle and a half later
+    task automatic ppu_read(input logic [13:0] a, output logic [7:0] data);
+        ppu_addr = a;
+        oe = 0;
+        #(PPU_CYC / 2);
+        oe = 1;
+        #(PPU_CYC * 3 / 2);
+        data = data_out;
+        oe = 0;
+    endtask
+
+    // Random API reads, the PPU fetches compete with them as with QSPI transfers
+    logic api_traffic = 0;
+    initial begin
+        wait (api_traffic);
+        while (api_traffic) begin
+            bus2.req = 1;
+            bus2.we = 0;
+            bus2.address = 22'h100000 | 22'($urandom);
+            @(posedge clk);
+            bus2.req = 0;
+            @(posedge clk iff bus2.ack);
+            repeat ($urandom_range(3)) @(posedge clk);
+        end
+    end
+
+    initial begin
+        $dumpfile("chr_ram_tb.vcd");
+        $dumpvars(0, chr_ram_tb);
+
+        reset = 1;
+        oe = 0;
+        ppu_addr = 14'h2000;
+        reqs = 0;
+        bursts = 0;
+        worst = 0;
+        #20 reset = 0;
+
+        wait (sdram_inst.state == sdram_inst.STATE_IDLE);
+
+        // Pattern table 0
+        for (int i = 0; i < 'h800; i++) write_word(22'(i), pattern(22'(i)));
+
+        // 1. Background tiles: nametable, attribute, pattern low, pattern high
+        begin
+            logic [7:0] data;
+            logic [12:0] low;
+
+            api_traffic = 1;
+            reqs = 0;
+            bursts = 0;
+            for (int t = 0; t < TILES; t++) begin
+                low = {1'b0, 8'($urandom), 1'b0, 3'(t / 32)};
+                ppu_read(14'h2000 | 14'(t), data);
+                ppu_read(14'h23C0 | 14'(t / 4), data);
+                ppu_read({1'b0, low}, data);
+                assert (data == pattern_byte(low))
+                else $fatal(1, "Tile %0d low plane %h: expected %h, got %h", t, low, pattern_byte(low), data);
+                ppu_read({1'b0, low | 13'h8}, data);
+                assert (data == pattern_byte(low | 13'h8))
+                else $fatal(1, "Tile %0d high plane %h: expected %h, got %h", t, low | 13'h8, pattern_byte(low | 13'h8), data);
+            end
+            api_traffic = 0;
+
+            // The high plane comes from the low plane burst
+            assert (reqs == TILES && bursts == TILES)
+            else $fatal(1, "%0d tiles: %0d fetches, %0d bursts", TILES, reqs, bursts);
+        end
+
+        // 2. $2007 reads don't follow a nametable fetch, one word each
+        begin
+            logic [7:0] data;
+            logic [12:0] a;
+
+            reqs = 0;
+            bursts = 0;
+            for (int i = 0; i < 8; i++) begin
+                a = 13'($urandom) & ~13'h8;
+                ppu_read({1'b0, a}, data);
+                assert (data == pattern_byte(a))
+                else $fatal(1, "Read %h: expected %h, got %h", a, pattern_byte(a), data);
+            end
+            assert (reqs == 8 && bursts == 0)
+            else $fatal(1, "8 reads: %0d fetches, %0d bursts", reqs, bursts);
+        end
+
+        $display("Worst PPU fetch: %0d clocks of %0d", worst, sdram_inst.PPU_DEADLINE);
+        $display("Testbench completed");
+        $finish;
+    end
+endmodule
@@ -56,14 +56,195 @@ module sdram_tb;
         .sdram_dqm (sdram_dqm)
     );
 
+    // Reference controller with auto-precharge for throughput comparison
+    wire [15:0] ref_dq;
+    wire [12:0] ref_addr;
+    wire [ 1:0] ref_bank;
+    wire [ 3:0] ref_command;
+    wire [ 1:0] ref_dqm;
+
+    sdram_bus #(.ADDR_BITS(24)) ref0 ();
+    sdram_bus #(.ADDR_BITS(24)) ref1 ();
+    sdram_bus #(.ADDR_BITS(24)) ref2 ();
+
+    W9825G6KH ref_model (
+        .Dq   (ref_dq),
+        .Addr (ref_addr),
+        .Bs   (ref_bank),
+        .Clk  (clk),
+        .Cke  (1'b1),
+        .Cs_n (ref_command[3]),
+        .Ras_n(ref_command[2]),
+        .Cas_n(ref_command[1]),
+        .We_n (ref_command[0]),
+        .Dqm  (ref_dqm)
+    );
+
+    sdram #(
+        .ROW_BITS(13),
+        .COL_BITS(9),
+        .OPEN_PAGE(0)
+    ) ram_ref (
+        .clk(clk),
+        .reset(reset),
+        .ch0(ref0),
+        .ch1(ref1),
+        .ch2(ref2),
+        .refresh(1'b0),
+
+        .sdram_cs  (ref_command[3]),
+        .sdram_addr(ref_addr),
+        .sdram_ba  (ref_bank),
+        .sdram_dq  (ref_dq),
+        .sdram_ras (ref_command[2]),
+        .sdram_cas (ref_command[1]),
+        .sdram_we  (ref_command[0]),
+        .sdram_dqm (ref_dqm)
+    );
+
+    localparam API_WORDS = 256;
+    int cycle = 0;
+    always @(posedge clk) cycle <= cycle + 1;
+
+    // Stream sequential words through the API channel and return the spent clocks
+    task automatic api_stream(virtual sdram_bus #(.ADDR_BITS(24)) bus, input logic we, input int words, output int cycles);
+        int start = cycle;
+        for (int i = 0; i < words; i++) begin
+            bus.req = 1;
+            bus.we = we;
+            bus.address = 'h1000 + i;
+            bus.data_write = 16'(i * 3);
+            bus.data_read = 'x;
+            @(posedge clk);
+            bus.req = 0;
+            @(posedge clk iff bus.ack);
+            if (!we) begin
+                assert (bus.data_read == 16'(i * 3))
+                else $fatal(1, "word %0d: %0h != %0h", i, bus.data_read, 16'(i * 3));
+            end
+        end
+        cycles = cycle - start;
+    endtask
+
+    task automatic api_throughput(input logic we);
+        int page_cycles, ref_cycles;
+
+        fork
+            api_stream(bus2, we, API_WORDS, page_cycles);
+            api_stream(ref2, we, API_WORDS, ref_cycles);
+        join
+
+        $display("API %s: row cycling %0d words in %0d clocks (%0.3f words/clock)", we ? "write" : "read", API_WORDS,
+                 ref_cycles, real'(API_WORDS) / ref_cycles);
+        $display("API %s: open row    %0d words in %0d clocks (%0.3f words/clock)", we ? "write" : "read", API_WORDS,
+                 page_cycles, real'(API_WORDS) / page_cycles);
+        assert (page_cycles < ref_cycles)
+        else $fatal(1, "open row is not faster: %0d >= %0d", page_cycles, ref_cycles);
+    endtask
+
+    // Clocks from request to acknowledge of a single read
+    task automatic read_latency(virtual sdram_bus #(.ADDR_BITS(24)) bus, input logic [23:0] address, output int cycles);
+        int start = cycle;
+        bus.req = 1;
+        bus.we = 0;
+        bus.address = address;
+        @(posedge clk);
+        bus.req = 0;
+        @(posedge clk iff bus.ack);
+        cycles = cycle - start;
+    endtask
+
+    // Single NES access, fails when the acknowledge comes after the deadline
+    task automatic nes_access(virtual sdram_bus #(.ADDR_BITS(24)) bus, input int deadline, input logic we,
+                              input logic [2:0] burst, inout int worst);
+        int start = cycle;
+        bus.req = 1;
+        bus.we = we;
+        bus.burst = we ? 3'd0 : burst;
+        bus.address = 24'($urandom);
+        bus.data_write = 16'($urandom);
+        @(posedge clk);
+        bus.req = 0;
+        @(posedge clk iff bus.ack);
+        if (cycle - start > worst) worst = cycle - start;
+        assert (cycle - start <= deadline)
+        else $fatal(1, "deadline missed: %0d > %0d clocks", cycle - start, deadline);
+        // rest of the burst
+        repeat (bus.burst) @(posedge clk iff bus.ack);
+    endtask
+
+    // NES bus timing: one access per period, or a pair of accesses gap clocks apart
+    // for the PPU pattern fetches. The period jitters by a clock like the real bus.
+    task automatic nes_traffic(virtual sdram_bus #(.ADDR_BITS(24)) bus, input int deadline, input int gap,
+                               input int period, input int writes, input logic [2:0] burst, input int until,
+                               output int worst);
+        int frame_start;
+        worst = 0;
+        while (cycle < until) begin
+            frame_start = cycle;
+            nes_access(bus, deadline, writes != 0 && $urandom_range(writes - 1) == 0, burst, worst);
+            if (gap != 0) begin
+                while (cycle < frame_start + gap) @(posedge clk);
+                nes_access(bus, deadline, 0, burst, worst);
+            end
+            while (cycle < frame_start + period + $urandom_range(1)) @(posedge clk);
+        end
+    endtask
+
+    // Saturate the API channel with random row misses while the NES buses run
+    task automatic deadline_stress(input int clocks);
+        int cpu_worst, ppu_worst, api_words;
+        int until = cycle + clocks;
+        logic flooding = 1;
+
+        api_words = 0;
+        fork
+            begin
+                fork
+                    nes_traffic(bus0, ram.CPU_DEADLINE, 0, 56, 4, 3'd3, until, cpu_worst);
+                    begin
+                        repeat ($urandom_range(73)) @(posedge clk);
+                        nes_traffic(bus1, ram.PPU_DEADLINE, 19, 74, 0, 3'd4, until, ppu_worst);
+                    end
+                join
+                flooding = 0;
+            end
+            while (flooding) begin
+                bus2.req = 1;
+                bus2.we = $urandom_range(1);
+                bus2.address = 24'($urandom);
+                bus2.data_write = 16'($urandom);
+                @(posedge clk);
+                bus2.req = 0;
+                @(posedge clk iff bus2.ack);
+                api_words++;
+            end
+        join
+
+        $display("Saturated API: CPU worst %0d/%0d clocks, PPU worst %0d/%0d clocks, API %0d words in %0d clocks",
+                 cpu_worst, ram.CPU_DEADLINE, ppu_worst, ram.PPU_DEADLINE, api_words, clocks);
+        assert (api_words > clocks / 64)
+        else $fatal(1, "API starved: %0d words", api_words);
+    endtask
+
     initial begin
         reset = 1;
         bus0.req = 0;
         bus0.wm = 2'b00;
+        bus0.burst = 0;
         bus1.req = 0;
         bus1.wm = 2'b00;
+        bus1.burst = 0;
         bus2.req = 0;
         bus2.wm = 2'b00;
+        bus2.burst = 0;
+        ref0.req = 0;
+        ref0.burst = 0;
+        ref1.req = 0;
+        ref1.burst = 0;
+        ref2.req = 0;
+        ref2.wm = 2'b00;
+        ref2.burst = 0;
         @(posedge clk) reset = 0;
 
         // skip powerup
@@ -83,8 +264,11 @@ module sdram_tb;
         @(posedge clk);
         bus0.req = 0;
         bus1.req = 0;
-        @(posedge clk iff bus0.ack);
-        @(posedge clk iff bus1.ack);
+        // the PPU request has the earlier deadline
+        fork
+            @(posedge clk iff bus0.ack);
+            @(posedge clk iff bus1.ack);
+        join
 
         // Parallel read
         bus0.data_read = 'x;
@@ -98,8 +282,11 @@ module sdram_tb;
         @(posedge clk);
         bus0.req = 0;
         bus1.req = 0;
-        @(posedge clk iff bus0.ack);
-        @(posedge clk iff bus1.ack);
+        // the PPU request has the earlier deadline
+        fork
+            @(posedge clk iff bus0.ack);
+            @(posedge clk iff bus1.ack);
+        join
         assert (bus0.data_read == 'hF7F8)
         else $fatal(1, "hF7F8 != %0h", bus0.data_read);
         assert (bus1.data_read == 'hA7F8)
@@ -131,6 +318,64 @@ module sdram_tb;
 
         wait (ram.state == ram.STATE_REFRESH);
         wait (ram.state == ram.STATE_IDLE);
+
+        // API burst throughput against the row cycling reference
+        refresh = 0;
+        wait (ram_ref.state == ram_ref.STATE_IDLE);
+        api_throughput(1);
+        api_throughput(0);
+
+        // CPU row miss closes the open API row
+        bus0.data_read = 'x;
+        bus0.req = 1;
+        bus0.we = 0;
+        bus0.address = 'h00;
+        @(posedge clk);
+        bus0.req = 0;
+        @(posedge clk iff bus0.ack);
+        assert (bus0.data_read == 'hF7F8)
+        else $fatal(1, "hF7F8 != %0h", bus0.data_read);
+
+        // PPU fetch from the row just opened by the CPU skips ACTIVATE
+        begin
+            int hit_cycles, ref_cycles;
+            fork
+                read_latency(bus1, 'h01, hit_cycles);
+                read_latency(ref1, 'h01, ref_cycles);
+            join
+            $display("PPU read latency: %0d clocks on row hit, %0d clocks with auto-precharge", hit_cycles, ref_cycles);
+            assert (hit_cycles < ref_cycles)
+            else $fatal(1, "row hit is not faster: %0d >= %0d", hit_cycles, ref_cycles);
+            assert (bus1.data_read == 'hA7F8)
+            else $fatal(1, "hA7F8 != %0h", bus1.data_read);
+        end
+
+        // Burst read returns the requested word first and wraps within the block
+        for (int i = 0; i < 4; i++) begin
+            bus0.req = 1;
+            bus0.we = 1;
+            bus0.address = 'h2000 + i;
+            bus0.data_write = 16'('h5A00 + i);
+            @(posedge clk);
+            bus0.req = 0;
+            @(posedge clk iff bus0.ack);
+        end
+        bus0.req = 1;
+        bus0.we = 0;
+        bus0.burst = 3;
+        bus0.address = 'h2002;
+        @(posedge clk);
+        bus0.req = 0;
+        for (int i = 0; i < 4; i++) begin
+            @(posedge clk iff bus0.ack);
+            assert (bus0.data_read == 16'('h5A00 + ((i + 2) % 4)))
+            else $fatal(1, "burst word %0d: %0h != %0h", i, bus0.data_read, 16'('h5A00 + ((i + 2) % 4)));
+        end
+        bus0.burst = 0;
+
+        // CPU and PPU deadlines hold across several refresh intervals
+        deadline_stress(ram.REFRESH_INTERVAL * 10);
+
         $finish;
     end
 endmodule
@@ -210,7 +210,7 @@ reset:
         lda initial_palette,x
         sta PPU_DATA
         inx
-        cpx #4
+        cpx #16
         bcc copy_palete
 
     ; fill nametable with a pattern
@@ -525,7 +525,10 @@ irq:
     rti
 
 initial_palette:
-	.byte $0F,$30,$28,$21
+	.byte $0F,$30,$28,$21 ; bitmap
+	.byte $0F,$28,$0F,$0F ; text: directory
+	.byte $0F,$0F,$21,$30 ; text: highlighted file
+	.byte $0F,$0F,$21,$28 ; text: highlighted directory
 
 .segment "RTI_TRAP"
 resume_app:
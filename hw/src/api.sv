@@ -12,6 +12,18 @@ module api (
     output logic wr_reg_changed,
     input logic [31:0] ev_reg,
 
+    output logic [4:0] perf_sel,
+    input logic [31:0] perf_value,
+    output logic perf_freeze,
+    output logic perf_clear,
+    output logic stat_words,  // QSPI word moved
+    output logic stat_rx_empty,  // Waiting for the host to send data
+    output logic stat_tx_full,  // Waiting for the host to take data
+    input logic [31:0] crc,  // CRC32 state from the QSPI clock domain, static between transfers
+    output logic [1:0] dirty_sel,
+    input logic [31:0] dirty_value,
+    output logic dirty_snap,  // Move the WRAM dirty bitmap into the readable snapshot
+
     sdram_bus.controller ram,
 
     input logic [15:0] rd_data,
@@ -20,13 +32,17 @@ module api (
     output logic [15:0] wr_data,
     input logic wr_valid,
     output logic wr_ready,
-    input logic start
+    input logic start,
+    input logic active
 );
     localparam [15:0] VERSION = `FCART_VERSION;
-    localparam CMD_READ_MEM = 2'd0;
-    localparam CMD_WRITE_MEM = 2'd1;
-    localparam CMD_READ_REG = 2'd2;
-    localparam CMD_WRITE_REG = 2'd3;
+    localparam CMD_READ_MEM = 4'd0;
+    localparam CMD_WRITE_MEM = 4'd1;
+    localparam CMD_READ_REG = 4'd2;
+    localparam CMD_WRITE_REG = 4'd3;
+    localparam CMD_FILL_MEM = 4'd5;
+    localparam CMD_COPY_MEM = 4'd7;
+    localparam CMD_CRC_MEM = 4'd9;
 
     enum logic [1:0] {
         STATE_IDLE,
@@ -35,32 +51,65 @@ module api (
         STATE_DATA
     } state;
 
-    logic [1:0] cmd;
+    logic [3:0] cmd;
     logic [3:0] reg_addr;
     logic [31:0] got_reg;
-    logic word_cnt;
+    logic [31:0] reg_latch;
+    logic [1:0] word_cnt;
     logic ram_busy;
+    logic [21:0] mem_addr;
+
+    // FILL, COPY and CRC engine, runs on its own after the command is received
+    logic eng_busy;
+    logic eng_copy;
+    logic eng_sum;
+    logic eng_pending;
+    logic eng_have;  // COPY word read and waiting to be written
+    logic eng_we;
+    logic [21:0] eng_addr, eng_src, eng_dst;
+    logic [31:0] eng_param;
+    logic [21:0] eng_left;
+    logic [15:0] eng_data;
+    logic [31:0] eng_crc, eng_crc_next;
+
+    crc32 crc32 (
+        .crc_in(eng_crc),
+        .data({ram.data_read[7:0], ram.data_read[15:8]}),
+        .crc_out(eng_crc_next)
+    );
 
     assign fpga_irq = (got_reg != ev_reg);
-    assign ram.we   = (cmd == CMD_WRITE_MEM);
+    assign ram.address = eng_busy ? eng_addr : mem_addr;
+    assign ram.we   = eng_busy ? eng_we : (cmd == CMD_WRITE_MEM);
     assign ram.wm   = 2'b00;  // Always write full word
+    assign ram.burst = '0;
+
+    assign stat_words = rd_ready || wr_ready;
+    assign stat_rx_empty = active && state == STATE_DATA && cmd == CMD_WRITE_MEM && !ram_busy && !rd_valid;
+    assign stat_tx_full = active && state == STATE_DATA && cmd == CMD_READ_MEM && !wr_valid;
 
     always_ff @(posedge clk) begin
         ram.req  <= 0;
         rd_ready <= 0;
         wr_ready <= 0;
+        perf_clear <= 0;
+        dirty_snap <= 0;
 
         if (reset) begin
             state <= STATE_IDLE;
             got_reg <= '1;
             wr_reg_changed <= 0;
+            perf_freeze <= 0;
+            eng_busy <= 0;
+            eng_pending <= 0;
+            eng_crc <= '1;
         end else begin
             if (start) begin
                 state <= STATE_CMD;
             end
 
-            if (ram.ack && state == STATE_DATA) begin
-                ram.address <= ram.address + 1;
+            if (ram.ack && ram_busy && state == STATE_DATA) begin
+                mem_addr <= mem_addr + 1;
                 if (cmd == CMD_READ_MEM) begin
                     wr_ready <= 1;
                     wr_data  <= {ram.data_read[7:0], ram.data_read[15:8]};
@@ -71,19 +120,21 @@ module api (
             if (rd_valid && !rd_ready) begin
                 case (state)
                     STATE_CMD: begin
-                        cmd                <= rd_data[9:8];
-                        ram.address[21:15] <= rd_data[6:0];
-                        state              <= STATE_ADDR;
-                        rd_ready           <= 1;
+                        cmd             <= rd_data[11:8];
+                        mem_addr[21:15] <= rd_data[6:0];
+                        state           <= STATE_ADDR;
+                        rd_ready        <= 1;
                     end
                     STATE_ADDR: begin
-                        ram.address[14:7] <= rd_data[15:8];
-                        ram.address[6:0]  <= rd_data[7:1];
-                        reg_addr          <= rd_data[3:0];
-                        state             <= STATE_DATA;
-                        rd_ready          <= 1;
-                        word_cnt          <= '0;
-                        ram_busy          <= 0;
+                        mem_addr[14:7] <= rd_data[15:8];
+                        mem_addr[6:0]  <= rd_data[7:1];
+                        reg_addr       <= rd_data[3:0];
+                        perf_sel       <= rd_data[12:8];
+                        dirty_sel      <= rd_data[9:8];
+                        state          <= STATE_DATA;
+                        rd_ready       <= 1;
+                        word_cnt       <= '0;
+                        ram_busy       <= 0;
                     end
                     STATE_DATA: begin
                         if (cmd == CMD_WRITE_REG) begin
@@ -94,17 +145,69 @@ module api (
                                 wr_reg_changed <= !wr_reg_changed;
                                 wr_reg_addr <= reg_addr;
                                 state <= STATE_IDLE;
+                                if (reg_addr == 4'd3) begin
+                                    perf_freeze <= wr_reg[0];
+                                    perf_clear  <= wr_reg[1];
+                                end
+                                if (reg_addr == 4'd7) begin
+                                    dirty_snap <= 1;
+                                end
+                                if (reg_addr == 4'd6 && !eng_busy) begin
+                                    eng_crc <= '1;
+                                end
                             end
 
                             rd_ready <= 1;
                             word_cnt <= word_cnt + 1;
                         end else if (cmd == CMD_WRITE_MEM) begin
-                            if (!ram_busy) begin
+                            if (!ram_busy && !eng_busy) begin
                                 ram.data_write <= {rd_data[7:0], rd_data[15:8]};
                                 ram.req <= 1;
                                 ram_busy <= 1;
                                 rd_ready <= 1;
                             end
+                        end else if ((cmd == CMD_FILL_MEM || cmd == CMD_COPY_MEM || cmd == CMD_CRC_MEM) && !eng_busy) begin
+                            // FILL: length, pattern. COPY: source address, length. CRC: length. All in bytes.
+                            if (word_cnt == 0) begin
+                                eng_param[15:0] <= {rd_data[7:0], rd_data[15:8]};
+                            end else if (word_cnt == 1) begin
+                                if (cmd == CMD_CRC_MEM) begin
+                                    eng_left <= {rd_data[14:8], eng_param[15:1]};
+                                    eng_dst  <= mem_addr;
+                                    eng_copy <= 0;
+                                    eng_sum  <= 1;
+                                    eng_have <= 0;
+                                    eng_busy <= 1;
+                                    state    <= STATE_IDLE;
+                                end else if (cmd == CMD_FILL_MEM) begin
+                                    eng_left <= {rd_data[14:8], eng_param[15:1]};
+                                end else begin
+                                    eng_src <= {rd_data[14:8], eng_param[15:1]};
+                                end
+                            end else if (word_cnt == 2) begin
+                                if (cmd == CMD_FILL_MEM) begin
+                                    eng_data <= {rd_data[7:0], rd_data[15:8]};
+                                    eng_dst  <= mem_addr;
+                                    eng_copy <= 0;
+                                    eng_sum  <= 0;
+                                    eng_have <= 0;
+                                    eng_busy <= 1;
+                                    state    <= STATE_IDLE;
+                                end else begin
+                                    eng_param[15:0] <= {rd_data[7:0], rd_data[15:8]};
+                                end
+                            end else begin
+                                eng_left <= {rd_data[14:8], eng_param[15:1]};
+                                eng_dst  <= mem_addr;
+                                eng_copy <= 1;
+                                eng_sum  <= 0;
+                                eng_have <= 0;
+                                eng_busy <= 1;
+                                state    <= STATE_IDLE;
+                            end
+
+                            rd_ready <= 1;
+                            word_cnt <= word_cnt + 1;
                         end
                     end
                     default;
@@ -118,6 +221,22 @@ module api (
                         wr_data <= (word_cnt == 0) ? {ev_reg[7:0], ev_reg[15:8]} : {got_reg[23:16], got_reg[31:24]};
                     end else if (reg_addr == 4'd2) begin
                         wr_data <= (word_cnt == 0) ? {VERSION[7:0], VERSION[15:8]} : 16'd0;
+                    end else if (reg_addr == 4'd3) begin
+                        // Counter selected by address bits [12:8]
+                        reg_latch <= perf_value;
+                        wr_data <= (word_cnt == 0) ? {perf_value[7:0], perf_value[15:8]} : {reg_latch[23:16], reg_latch[31:24]};
+                    end else if (reg_addr == 4'd4) begin
+                        reg_latch <= ~crc;
+                        wr_data <= (word_cnt == 0) ? {~crc[7:0], ~crc[15:8]} : {reg_latch[23:16], reg_latch[31:24]};
+                    end else if (reg_addr == 4'd5) begin
+                        wr_data <= (word_cnt == 0) ? {7'd0, eng_busy, 8'd0} : 16'd0;
+                    end else if (reg_addr == 4'd6) begin
+                        reg_latch <= ~eng_crc;
+                        wr_data <= (word_cnt == 0) ? {~eng_crc[7:0], ~eng_crc[15:8]} : {reg_latch[23:16], reg_latch[31:24]};
+                    end else if (reg_addr == 4'd7) begin
+                        // Snapshot word selected by address bits [9:8]
+                        reg_latch <= dirty_value;
+                        wr_data <= (word_cnt == 0) ? {dirty_value[7:0], dirty_value[15:8]} : {reg_latch[23:16], reg_latch[31:24]};
                     end
 
                     wr_ready <= 1;
@@ -127,12 +246,41 @@ module api (
                         state <= STATE_IDLE;
                     end
                 end else if (cmd == CMD_READ_MEM) begin
-                    if (!ram_busy) begin
+                    if (!ram_busy && !eng_busy) begin
                         ram.req  <= 1;
                         ram_busy <= 1;
                     end
                 end
             end
+
+            // FILL writes the pattern word by word, COPY reads a word from the
+            // source and writes it to the destination, in ascending order.
+            // CRC only reads and accumulates the CRC32 of SDRAM contents.
+            if (eng_busy) begin
+                if (!eng_pending) begin
+                    if (eng_left == 0) begin
+                        eng_busy <= 0;
+                    end else begin
+                        eng_we <= !eng_sum && (!eng_copy || eng_have);
+                        eng_addr <= (eng_copy && !eng_have) ? eng_src : eng_dst;
+                        ram.data_write <= eng_data;
+                        ram.req <= 1;
+                        eng_pending <= 1;
+                    end
+                end else if (ram.ack) begin
+                    eng_pending <= 0;
+                    if (eng_copy && !eng_have) begin
+                        eng_data <= ram.data_read;
+                        eng_src  <= eng_src + 1;
+                        eng_have <= 1;
+                    end else begin
+                        if (eng_sum) eng_crc <= eng_crc_next;
+                        eng_dst  <= eng_dst + 1;
+                        eng_left <= eng_left - 1;
+                        eng_have <= 0;
+                    end
+                end
+            end
         end
     end
 
@@ -5,6 +5,7 @@ module chr_ram #(
     sdram_bus.controller ram,
 
     input logic [ADDR_BITS-1:0] addr,
+    input logic ppu_a13,
     input logic [7:0] data_in,
     output logic [7:0] data_out,
     input logic ce,
@@ -15,8 +16,28 @@ module chr_ram #(
     logic [2:0] write_sync;
     logic [2:0][ADDR_BITS-1:0] addr_gray;
     logic [3:0] match_addr;
+    logic [15:0] word;
+    logic [15:0] data_word;
+    logic fetching;
+    logic [2:0] ack_cnt;
+    logic [1:0] rd_sync;
+    logic [1:0] a13_sync;
+    logic after_nt;
 
-    assign data_out = addr[0] ? ram.data_read[15:8] : ram.data_read[7:0];
+    // A write that lands during a burst waits for its last word
+    logic [ADDR_BITS-1:0] wr_addr;
+    logic [7:0] wr_data;
+    logic wr_pending;
+
+    // Pattern high plane lies 8 bytes after the low plane of the same tile row.
+    // It is read in the same burst and the following fetch is served from here.
+    logic [ADDR_BITS-2:0] pred_addr;
+    logic [15:0] pred_data;
+    logic pred_valid;
+
+    // The fetched word goes out in its ack clock, PPU_DEADLINE has no clock to spare for the latch
+    assign data_word = (fetching && ram.ack && ack_cnt == 0) ? ram.data_read : word;
+    assign data_out = addr[0] ? data_word[15:8] : data_word[7:0];
 
     always_ff @(posedge clk) begin
         ram.req <= 1'b0;
@@ -25,6 +46,13 @@ module chr_ram #(
         read_sync <= {read_sync[0], ce && !oe};
         write_sync <= {write_sync[1:0], ce && we};
         addr_gray <= {addr_gray[1:0], addr ^ (addr >> 1)};
+        rd_sync <= {rd_sync[0], oe};
+        a13_sync <= {a13_sync[0], ppu_a13};
+
+        // While rendering, the low plane of a tile row is fetched right after its
+        // nametable and attribute bytes, or after the dummy nametable reads of a sprite.
+        // $2007 reads don't follow such a fetch.
+        if (rd_sync == 2'b01) after_nt <= a13_sync[1];
 
         if (read_sync[1] && addr_gray[2] == addr_gray[1]) begin
             match_addr <= {match_addr[2:0], 1'b1};
@@ -33,15 +61,45 @@ module chr_ram #(
         end
 
         if (match_addr == 4'b0111) begin
-            ram.we <= 1'b0;
-            ram.address <= addr[ADDR_BITS-1:1];
-            ram.req <= 1'b1;
-        end else if (write_sync[2:1] == 2'b10) begin
+            if (pred_valid && pred_addr == addr[ADDR_BITS-1:1]) begin
+                word <= pred_data;
+            end else begin
+                ram.we <= 1'b0;
+                ram.address <= addr[ADDR_BITS-1:1];
+                // Low plane (A3 = 0) reads up to the high plane word
+                ram.burst <= (!addr[3] && !a13_sync[1] && after_nt) ? 3'd4 : 3'd0;
+                ram.req <= 1'b1;
+                fetching <= 1'b1;
+                ack_cnt <= '0;
+                pred_valid <= 1'b0;
+                pred_addr <= addr[ADDR_BITS-1:1] | 4'd4;
+            end
+        end else if (wr_pending && !fetching) begin
             ram.we <= 1'b1;
-            ram.address <= addr[ADDR_BITS-1:1];
-            ram.data_write <= {data_in, data_in};
-            ram.wm <= addr[0] ? 2'b01 : 2'b10;
+            ram.address <= wr_addr[ADDR_BITS-1:1];
+            ram.data_write <= {wr_data, wr_data};
+            ram.wm <= wr_addr[0] ? 2'b01 : 2'b10;
+            ram.burst <= '0;
             ram.req <= 1'b1;
+            wr_pending <= 1'b0;
+        end
+
+        if (fetching && ram.ack) begin
+            ack_cnt <= ack_cnt + 1'd1;
+            if (ack_cnt == 0) word <= ram.data_read;
+            if (ack_cnt == 3'd4) begin
+                pred_data  <= ram.data_read;
+                // The high plane word may predate a write that waits for this burst
+                pred_valid <= !wr_pending;
+            end
+            if (ack_cnt == ram.burst) fetching <= 1'b0;
+        end
+
+        if (write_sync[2:1] == 2'b10) begin
+            wr_addr <= addr;
+            wr_data <= data_in;
+            wr_pending <= 1'b1;
+            pred_valid <= 1'b0;
         end
     end
 endmodule
@@ -0,0 +1,13 @@
+// One step of CRC-32 (IEEE 802.3, reflected) over a 16-bit word, low address byte first.
+module crc32 (
+    input  logic [31:0] crc_in,
+    input  logic [15:0] data,  // {first byte, second byte}
+    output logic [31:0] crc_out
+);
+    always_comb begin
+        crc_out = crc_in ^ {24'd0, data[15:8]};
+        for (int i = 0; i < 8; i++) crc_out = (crc_out >> 1) ^ (32'hEDB88320 & {32{crc_out[0]}});
+        crc_out = crc_out ^ {24'd0, data[7:0]};
+        for (int i = 0; i < 8; i++) crc_out = (crc_out >> 1) ^ (32'hEDB88320 & {32{crc_out[0]}});
+    end
+endmodule
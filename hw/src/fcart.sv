@@ -48,8 +48,18 @@ module fcart (
     logic wr_reg_changed;
     logic [31:0] launcher_status;
     logic sdram_refresh;
+    logic prg_hit, prg_miss;
+    logic [1:0] dirty_sel;
+    logic [31:0] dirty_value;
+    logic dirty_snap;
     logic [15:0] pcm;
     logic [7:0] joy1;
+    logic [2:0] sdram_wait;
+    logic sdram_refreshed, sdram_deferred;
+    logic [4:0] perf_sel;
+    logic [31:0] perf_value;
+    logic perf_freeze, perf_clear;
+    logic api_words, api_rx_empty, api_tx_full;
 
     assign CPU_DATA = CPU_DIR ? cpu_data_out : 'z;
     assign PPU_DATA = PPU_DIR ? ppu_data_out : 'z;
@@ -70,6 +80,11 @@ module fcart (
         .ch_prg(ch_cpu.controller),
         .ch_chr(ch_ppu.controller),
         .refresh(sdram_refresh),
+        .prg_hit(prg_hit),
+        .prg_miss(prg_miss),
+        .dirty_sel(dirty_sel),
+        .dirty_value(dirty_value),
+        .dirty_snap(dirty_snap),
 
         .m2(M2),
         .cpu_addr({!ROMSEL, CPU_ADDR}),
@@ -127,6 +142,9 @@ module fcart (
         .ch1(ch_ppu.memory),
         .ch2(ch_api.memory),
         .refresh(sdram_refresh),
+        .stat_wait(sdram_wait),
+        .stat_refresh(sdram_refreshed),
+        .stat_defer(sdram_deferred),
         .sdram_cs(SDRAM_CS),
         .sdram_addr(SDRAM_ADDR),
         .sdram_ba(SDRAM_BA),
@@ -144,6 +162,8 @@ module fcart (
     logic qspi_wr_valid;
     logic qspi_wr_ready;
     logic qspi_start;
+    logic qspi_active;
+    logic [31:0] qspi_crc;
     qspi qspi (
         .clk(clk),
         .async_reset(!async_nreset),
@@ -158,7 +178,9 @@ module fcart (
         .wr_data(qspi_wr_data),
         .wr_valid(qspi_wr_valid),
         .wr_ready(qspi_wr_ready),
-        .start(qspi_start)
+        .start(qspi_start),
+        .active(qspi_active),
+        .crc(qspi_crc)
     );
 
     api api (
@@ -171,6 +193,18 @@ module fcart (
         .wr_reg_changed(wr_reg_changed),
         .ev_reg(launcher_status),
 
+        .perf_sel(perf_sel),
+        .perf_value(perf_value),
+        .perf_freeze(perf_freeze),
+        .perf_clear(perf_clear),
+        .stat_words(api_words),
+        .stat_rx_empty(api_rx_empty),
+        .stat_tx_full(api_tx_full),
+        .crc(qspi_crc),
+        .dirty_sel(dirty_sel),
+        .dirty_value(dirty_value),
+        .dirty_snap(dirty_snap),
+
         .ram(ch_api.controller),
 
         .rd_data(qspi_rd_data),
@@ -179,6 +213,36 @@ module fcart (
         .wr_data(qspi_wr_data),
         .wr_valid(qspi_wr_valid),
         .wr_ready(qspi_wr_ready),
-        .start(qspi_start)
+        .start(qspi_start),
+        .active(qspi_active)
+    );
+
+    // Counter indexes match enum fpga_perf_counter in the firmware
+    perf perf (
+        .clk(clk),
+        .reset(reset),
+        .inc({
+            prg_miss,  // 16 PRG cache misses
+            prg_hit,  // 15 PRG cache hits
+            api_tx_full,  // 14 QSPI TX FIFO full
+            api_rx_empty,  // 13 QSPI RX FIFO empty
+            api_words,  // 12 QSPI words
+            sdram_deferred,  // 11 refresh deferred clocks
+            sdram_refreshed,  // 10 refreshes
+            sdram_wait[2],  // 9 API wait clocks
+            ch_api.ack,  // 8 API acks
+            ch_api.req,  // 7 API requests
+            sdram_wait[1],  // 6 PPU wait clocks
+            ch_ppu.ack,  // 5 PPU acks
+            ch_ppu.req,  // 4 PPU requests
+            sdram_wait[0],  // 3 CPU wait clocks
+            ch_cpu.ack,  // 2 CPU acks
+            ch_cpu.req,  // 1 CPU requests
+            1'b1  // 0 clocks
+        }),
+        .freeze(perf_freeze),
+        .clear(perf_clear),
+        .sel(perf_sel),
+        .value(perf_value)
     );
 endmodule
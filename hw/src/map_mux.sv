@@ -5,6 +5,11 @@ module map_mux #(
     sdram_bus.controller ch_prg,
     sdram_bus.controller ch_chr,
     output logic refresh,
+    output logic prg_hit,
+    output logic prg_miss,
+    input logic [1:0] dirty_sel,
+    output logic [31:0] dirty_value,
+    input logic dirty_snap,
 
     // Cart interface
     input logic m2,
@@ -35,16 +40,20 @@ module map_mux #(
     // PRG ROM:       ........ dynamic size
     // CHR ROM:       ........ dynamic size
     // CHR RAM:       ........ dynamic size
-    // SAVES STATES:  11111010 7D0000 32KB
+    // DIR LISTING:   110..... 600000 1856KB, firmware only
+    // SAVES STATES:  11111010 7D0000 16KB
+    // LAUNCHER FONT: 11111010 7D4000 16KB
     // LAUNCHER VRAM: 11111011 7D8000 32KB
     // CPU WRAM:      111111.. 7E0000 128KB
     localparam SST_MASK = {8'b11111010, {ADDR_BITS - 8{1'b0}}};
     localparam LAUNCHER_MASK = {8'b11111011, {ADDR_BITS - 8{1'b0}}};
     localparam WRAM_MASK = {6'b111111, {ADDR_BITS - 6{1'b0}}};
+    localparam DIRTY_PAGES = 128;  // 256 byte pages, first 32KB of WRAM
 
     localparam MAP_CNT = 10;
     localparam MAP_BITS = $clog2(MAP_CNT);
 
+    localparam CTRL_TEXT_MODE = 5;
     localparam CTRL_ROM_LOADED = 4;
     localparam CTRL_INGAME_MENU = 3;
     localparam CTRL_RESTORE_APP = 2;
@@ -56,13 +65,15 @@ module map_mux #(
     logic bus_conflict;
     logic [ADDR_BITS-1:0] prg_mask, chr_mask;
     logic [7:0] prg_data_out, chr_data_out;
-    logic [4:0] launcher_ctrl;
-    logic [1:0] launcher_status;
+    logic [5:0] launcher_ctrl;
+    logic [4:0] launcher_scroll;
+    logic [2:0] launcher_status;
     logic video_enable;
     logic nmi_hijack;
     logic [9:0] st_rec_addr;
     logic [7:0] st_rec_read, st_rec_write;
     logic [7:0] st_rec_read_recorder;
+    logic prg_written;
 
     // Muxed bus signals
     logic [7:0] bus_cpu_data_out[MAP_CNT];
@@ -97,6 +108,7 @@ module map_mux #(
     launcher launcher (
         .bus(map[0]),
         .ctrl(launcher_ctrl),
+        .text_scroll(launcher_scroll),
         .status(launcher_status),
         .st_rec_addr(st_rec_addr),
         .st_rec_read(st_rec_read),
@@ -189,6 +201,11 @@ module map_mux #(
         .m2(m2),
         .ram(ch_prg),
         .refresh(refresh),
+        // The launcher runs while the firmware rewrites ROM and WRAM
+        .flush(select == '0),
+        .stat_hit(prg_hit),
+        .stat_miss(prg_miss),
+        .written(prg_written),
         .addr(prg_addr_in),
         .data_in(cpu_data_in),
         .data_out(prg_data_out),
@@ -196,6 +213,21 @@ module map_mux #(
         .we(bus_prg_we[select])
     );
 
+    // CPU writes to the first 32KB of WRAM mark their 256 byte page dirty
+    logic [ADDR_BITS-2:0] wr_word;
+    assign wr_word = ch_prg.address;
+
+    wram_dirty #(
+        .PAGES(DIRTY_PAGES)
+    ) wram_dirty (
+        .clk(clk),
+        .written(prg_written && wr_word[ADDR_BITS-2-:6] == '1 && wr_word[ADDR_BITS-8:14] == '0),
+        .page(wr_word[13:7]),
+        .snap(dirty_snap),
+        .sel(dirty_sel),
+        .value(dirty_value)
+    );
+
     logic [ADDR_BITS-1:0] chr_addr_in;
     assign chr_addr_in = bus_chr_addr[select] + ((select == '0) ? LAUNCHER_MASK : chr_mask);
 
@@ -203,6 +235,7 @@ module map_mux #(
         .clk(clk),
         .ram(ch_chr),
         .addr(chr_addr_in),
+        .ppu_a13(ppu_addr[13]),
         .data_in(ppu_data_in),
         .data_out(chr_data_out),
         .ce(bus_chr_ce[select]),
@@ -222,6 +255,7 @@ module map_mux #(
             chr_mask <= '0;
             map_args <= '0;
             launcher_ctrl <= '0;
+            launcher_scroll <= '0;
         end else begin
             wr_reg_sync <= {wr_reg_sync[1:0], wr_reg_changed};
             if (wr_reg_sync[1] != wr_reg_sync[2]) begin
@@ -231,7 +265,8 @@ module map_mux #(
                     prg_mask <= ADDR_BITS'((1 << wr_reg[9:5]) - 5'd1);
                     chr_mask <= ADDR_BITS'(1 << wr_reg[9:5]);
                 end else if (wr_reg_addr == REG_LAUNCHER) begin
-                    launcher_ctrl <= wr_reg[4:0];
+                    launcher_ctrl <= wr_reg[5:0];
+                    launcher_scroll <= wr_reg[10:6];
                 end
             end
 
@@ -240,6 +275,7 @@ module map_mux #(
                 select_reg <= game_select;
                 launcher_ctrl[CTRL_START_APP] <= 0;
                 launcher_ctrl[CTRL_ROM_LOADED] <= 0;
+                launcher_ctrl[CTRL_TEXT_MODE] <= 0;
             end
 
             // Enter in-game menu
@@ -268,6 +304,7 @@ module map_mux #(
         if (m2_sync[2:1] == 2'b10) begin
             status_reg <= {23'd0, launcher_status[0], joy1};
             status_reg[10] <= (select_reg != 0);
+            status_reg[11] <= launcher_status[2];
             reset_seq <= '0;
         end else if (reset_seq != '1) begin
             reset_seq <= reset_seq + 1;
@@ -1,11 +1,18 @@
 module launcher (
     map_bus.mapper bus,
-    input logic [4:0] ctrl,
-    output logic [1:0] status,
+    input logic [5:0] ctrl,
+    input logic [4:0] text_scroll,  // Ring offset of the text mode list rows
+    output logic [2:0] status,  // {frame toggle, loader magic read, running}
     output logic [9:0] st_rec_addr,
     input logic [7:0] st_rec_read,
     output logic [7:0] st_rec_write
 );
+    // Text mode font lives 16KB below the launcher VRAM, in the unused part of the save state area
+    localparam FONT_OFFSET = 'h4000;
+    // Text rows of the file list, stored as a ring so scrolling rewrites a single row
+    localparam RING_FIRST = 2;
+    localparam RING_ROWS = 26;
+
     (* syn_romstyle = "block_ram" *) logic [7:0] rom[1024];
     initial $readmemh("launcher/launcher.mem", rom);
 
@@ -19,13 +26,17 @@ module launcher (
     logic rec_hi;
     logic sst_inc;
     logic rec_inc;
+    logic text_mode;
+    logic [4:0] nt_row;
+    logic [4:0] ring_row;
+    logic [5:0] ring_pos;
 
     assign bus.prg_ce = (bus.cpu_addr == 'h5003);
     assign bus.prg_oe = bus.cpu_rw && (bus.cpu_addr[15] || (bus.cpu_addr == 'h5000) || (bus.cpu_addr == 'h5003) || (bus.cpu_addr == 'h5005) || (bus.cpu_addr == 'h5006));
     assign bus.prg_we = !bus.cpu_rw && (bus.cpu_addr == 'h5003);
-    assign bus.chr_addr = bus.ADDR_BITS'({ctrl[0], chr_bank, bus.ppu_addr[11:0]});
-    assign bus.ciram_ce = !bus.ppu_addr[13];
-    assign bus.chr_ce = bus.ciram_ce;
+    assign text_mode = ctrl[5];
+    assign bus.ciram_ce = text_mode || !bus.ppu_addr[13];
+    assign bus.chr_ce = text_mode || !bus.ppu_addr[13];
     assign bus.chr_oe = !bus.ppu_rd;
     assign bus.chr_we = 0;
     assign bus.ciram_a10 = bus.ppu_addr[10];
@@ -36,6 +47,34 @@ module launcher (
     assign bus.sst_data_out = 'hFF;
     assign st_rec_write = bus.cpu_data_in;
 
+    // Bitmap mode gives every screen tile its own pattern by switching 4KB banks every 64 scanlines.
+    // Text mode fetches patterns from the font and the nametable from the last 1KB of the frame,
+    // which the bitmap leaves unused. Attribute fetches return the palette of the row whose
+    // nametable byte was just read, so each text row gets its own colors.
+    always_comb begin
+        if (!text_mode) begin
+            bus.chr_addr = bus.ADDR_BITS'({ctrl[0], chr_bank, bus.ppu_addr[11:0]});
+        end else if (!bus.ppu_addr[13]) begin
+            bus.chr_addr = bus.ADDR_BITS'(bus.ppu_addr[11:0]) - bus.ADDR_BITS'(FONT_OFFSET);
+        end else if (bus.ppu_addr[9:6] == 4'hF) begin
+            bus.chr_addr = bus.ADDR_BITS'({ctrl[0], 4'hF, 5'b11110, nt_row});
+        end else begin
+            bus.chr_addr = bus.ADDR_BITS'({ctrl[0], 4'hF, ring_row, bus.ppu_addr[4:0]});
+        end
+    end
+
+    // Nametable row stored in SDRAM for a screen row of the list
+    always_comb begin
+        ring_pos = 6'(bus.ppu_addr[9:5] - RING_FIRST) + text_scroll;
+        if (bus.ppu_addr[9:5] < RING_FIRST || bus.ppu_addr[9:5] >= RING_FIRST + RING_ROWS) begin
+            ring_row = bus.ppu_addr[9:5];
+        end else if (ring_pos >= RING_ROWS) begin
+            ring_row = 5'(ring_pos - RING_ROWS + RING_FIRST);
+        end else begin
+            ring_row = 5'(ring_pos + RING_FIRST);
+        end
+    end
+
     logic [7:0] rom_q;
     always_ff @(posedge bus.m2) begin
         if (bus.cpu_rw) rom_q <= rom[bus.cpu_addr[9:0]];
@@ -78,6 +117,7 @@ module launcher (
                 // read status register
                 if (bus.cpu_addr == 'h5001) begin
                     {status[0], vblank} <= bus.cpu_data_in[1:0];
+                    if (bus.cpu_data_in[0]) status[2] <= !status[2];  // Vblank NMI, one edge per frame
                 end else if (bus.cpu_addr == 'h5002) begin
                     if (sst_hi) bus.prg_addr[14:8] <= bus.cpu_data_in[6:0];
                     else bus.prg_addr[7:0] <= bus.cpu_data_in;
@@ -153,5 +193,6 @@ module launcher (
 
     always_ff @(negedge bus.ppu_rd) begin
         last_ppu_a13 <= bus.ppu_addr[13];
+        if (bus.ppu_addr[13] && bus.ppu_addr[9:6] != 4'hF) nt_row <= ring_row;
     end
 endmodule
@@ -0,0 +1,28 @@
+module perf #(
+    parameter COUNTERS = 17,
+    parameter WIDTH = 24  // Wraps after 168 ms of clocks at 100 MHz
+) (
+    input logic clk,
+    input logic reset,
+
+    input logic [COUNTERS-1:0] inc,  // Count enable per counter
+    input logic freeze,  // Hold all counters for a consistent snapshot
+    input logic clear,  // Zero all counters
+    input logic [4:0] sel,
+    output logic [31:0] value
+);
+    logic [WIDTH-1:0] cnt[COUNTERS];
+
+    // Not registered, api.sv sends the value on the clock after it latches sel
+    assign value = (sel < COUNTERS) ? 32'(cnt[sel]) : '0;
+
+    always_ff @(posedge clk) begin
+        for (int i = 0; i < COUNTERS; i++) begin
+            if (reset || clear) begin
+                cnt[i] <= '0;
+            end else if (inc[i] && !freeze) begin
+                cnt[i] <= cnt[i] + 1'd1;
+            end
+        end
+    end
+endmodule
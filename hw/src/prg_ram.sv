@@ -1,10 +1,16 @@
 module prg_ram #(
-    parameter ADDR_BITS = 23  // SDRAM width + 1
+    parameter ADDR_BITS  = 23,  // SDRAM width + 1
+    parameter LINE_BITS  = 2,   // 4 words per cache line
+    parameter INDEX_BITS = 8    // 256 lines in block RAM
 ) (
     input logic clk,
     input logic m2,
     sdram_bus.controller ram,
     output logic refresh,
+    input logic flush,  // Drop cached lines while the SDRAM is rewritten over the API
+    output logic stat_hit,
+    output logic stat_miss,
+    output logic written,  // CPU write issued to ram.address
 
     input logic [ADDR_BITS-1:0] addr,
     input logic [7:0] data_in,
@@ -12,13 +18,66 @@ module prg_ram #(
     input logic oe,
     input logic we
 );
-    logic [ADDR_BITS-2:0] addr_cached;
+    localparam WORD_BITS = ADDR_BITS - 1;
+    localparam TAG_BITS = WORD_BITS - INDEX_BITS - LINE_BITS;
+
+    // Direct mapped cache tagged by SDRAM address, so mapper bank switching
+    // needs no invalidation. Lines are filled with one SDRAM burst.
+    logic [TAG_BITS:0] tags[2**INDEX_BITS];  // {valid, tag}
+    logic [15:0] lines[2**(INDEX_BITS+LINE_BITS)];
+    logic [TAG_BITS:0] tag_q;
+    logic [15:0] line_q;
+    logic tag_we;
+    logic [INDEX_BITS-1:0] tag_waddr;
+    logic [TAG_BITS:0] tag_wdata;
+
+    logic [WORD_BITS-1:0] word_addr;
+    logic [15:0] word;
+    logic [15:0] data_word;
+    logic lookup, hit;
+    logic filling;
+    logic [LINE_BITS-1:0] fill_cnt;
+    logic [WORD_BITS-1:0] fill_addr;
+    logic [INDEX_BITS-1:0] sweep;
+    logic invalidate;
+
     logic [3:0] m2_sync;
     logic [7:0] data_in_reg;
     logic schedule_write;
     logic [2:0] we_sync;
 
-    assign data_out = addr[0] ? ram.data_read[15:8] : ram.data_read[7:0];
+    // A missed word goes out in its ack clock, CPU_DEADLINE has no clock to spare for the latch
+    assign data_word = (filling && ram.ack && fill_cnt == 0) ? ram.data_read : word;
+    assign data_out = addr[0] ? data_word[15:8] : data_word[7:0];
+    assign hit = !flush && tag_q == {1'b1, word_addr[WORD_BITS-1-:TAG_BITS]};
+    assign invalidate = schedule_write && we_sync[2:1] == 2'b10;
+    assign written = invalidate;
+
+    // Single tag write port: flush sweep, invalidation on CPU write, allocation on miss
+    always_comb begin
+        tag_we = 1'b1;
+        tag_waddr = word_addr[LINE_BITS+:INDEX_BITS];
+        tag_wdata = '0;
+        if (flush) begin
+            tag_waddr = sweep;
+        end else if (invalidate) begin
+            tag_waddr = ram.address[LINE_BITS+:INDEX_BITS];
+        end else if (lookup && !hit) begin
+            tag_wdata = {1'b1, word_addr[WORD_BITS-1-:TAG_BITS]};
+        end else begin
+            tag_we = 1'b0;
+        end
+    end
+
+    always_ff @(posedge clk) begin
+        if (tag_we) tags[tag_waddr] <= tag_wdata;
+        tag_q <= tags[addr[1+LINE_BITS+:INDEX_BITS]];
+    end
+
+    always_ff @(posedge clk) begin
+        if (filling && ram.ack) lines[fill_addr[LINE_BITS+INDEX_BITS-1:0]] <= ram.data_read;
+        line_q <= lines[addr[1+:LINE_BITS+INDEX_BITS]];
+    end
 
     // Capture data for write on falling M2 edge
     always_ff @(negedge m2) data_in_reg <= data_in;
@@ -26,29 +85,51 @@ module prg_ram #(
     always_ff @(posedge clk) begin
         ram.req <= 1'b0;
         refresh <= 1'b0;
+        stat_hit <= 1'b0;
+        stat_miss <= 1'b0;
+        lookup <= 1'b0;
         m2_sync <= {m2_sync[2:0], m2};
         we_sync <= {we_sync[1:0], we};
 
+        if (flush) sweep <= sweep + 1'd1;
+
         if (m2_sync[3:1] == 3'b011) begin
-            // Latch address on rising edge of M2 with little delay to wait for ROMSEL signal
+            // Latch address on rising edge of M2 with little delay to wait for ROMSEL signal.
+            // Tag and line are read in the same clock.
+            word_addr <= addr[ADDR_BITS-1:1];
             ram.address <= addr[ADDR_BITS-1:1];
             ram.wm <= addr[0] ? 2'b01 : 2'b10;
+            lookup <= oe;
+            schedule_write <= we;
+        end
 
-            if (oe) begin
-                if (addr_cached != addr[ADDR_BITS-1:1]) begin
-                    ram.we <= 1'b0;
-                    ram.req <= 1'b1;
-                    addr_cached <= addr[ADDR_BITS-1:1];
-                end else begin
-                    refresh <= 1'b1;
-                end
+        if (lookup) begin
+            if (hit) begin
+                word <= line_q;
+                refresh <= 1'b1;
+                stat_hit <= 1'b1;
+            end else begin
+                // Fetch the whole line, the CPU word comes first
+                ram.we <= 1'b0;
+                ram.burst <= 3'((1 << LINE_BITS) - 1);
+                ram.req <= 1'b1;
+                filling <= 1'b1;
+                fill_cnt <= '0;
+                fill_addr <= word_addr;
+                stat_miss <= 1'b1;
             end
+        end
 
-            schedule_write <= we;
+        if (filling && ram.ack) begin
+            if (fill_cnt == 0) word <= ram.data_read;
+            fill_addr[LINE_BITS-1:0] <= fill_addr[LINE_BITS-1:0] + 1'd1;
+            fill_cnt <= fill_cnt + 1'd1;
+            if (fill_cnt == '1) filling <= 1'b0;
         end
 
-        if (schedule_write && we_sync[2:1] == 2'b10) begin
+        if (invalidate) begin
             ram.we <= 1'b1;
+            ram.burst <= '0;
             ram.data_write <= {data_in_reg, data_in_reg};
             ram.req <= 1'b1;
             schedule_write <= 1'b0;
@@ -12,7 +12,9 @@ module qspi (
     input logic [15:0] wr_data,
     output logic wr_valid,
     input logic wr_ready,
-    output logic start
+    output logic start,
+    output logic active,  // NCS asserted
+    output logic [31:0] crc  // Running CRC32 state of memory data words
 );
     enum logic [1:0] {
         STATE_CMD,
@@ -29,6 +31,8 @@ module qspi (
     logic [3:0] io_out;
     logic [2:0] cnt;
     logic has_resp;
+    logic [3:0] cmd;
+    logic [1:0] rx_words;
 
     assign qspi_reset = async_reset || qspi_ncs;
     assign rd_valid   = !rx_empty;
@@ -79,6 +83,7 @@ module qspi (
 
             if (state == STATE_CMD && cnt == 3'd1) begin
                 has_resp <= (qspi_io[0] == 1'b0);  // Detect if the command expects a response
+                cmd <= qspi_io;
                 state <= STATE_RECEIVE;
             end else if (state == STATE_RECEIVE && has_resp && cnt == 3'd7) state <= STATE_DUMMY;
             else if (state == STATE_DUMMY && cnt == 3'd7) state <= STATE_SEND;
@@ -89,6 +94,38 @@ module qspi (
         rx_shift <= {rx_shift[7:0], qspi_io};
     end
 
+    // CRC32 over the memory data words that actually cross the link, so the
+    // read-ahead left in the TX FIFO is not counted. Writing register 4 resets it.
+    localparam CMD_READ_MEM = 4'd0;
+    localparam CMD_WRITE_MEM = 4'd1;
+    localparam CMD_WRITE_REG = 4'd3;
+    localparam REG_CRC = 4'd4;
+
+    logic [31:0] crc_next;
+    crc32 crc32 (
+        .crc_in(crc),
+        .data(tx_en ? tx_data : rx_data),
+        .crc_out(crc_next)
+    );
+
+    always_ff @(posedge qspi_clk or posedge qspi_reset) begin
+        if (qspi_reset) begin
+            rx_words <= '0;
+        end else if (rx_en && rx_words != 2'd2) begin
+            rx_words <= rx_words + 1'd1;
+        end
+    end
+
+    always_ff @(posedge qspi_clk) begin
+        if (rx_en && rx_words == 2'd1 && cmd == CMD_WRITE_REG && rx_data[3:0] == REG_CRC) begin
+            crc <= '1;
+        end else if (rx_en && rx_words == 2'd2 && cmd == CMD_WRITE_MEM) begin
+            crc <= crc_next;
+        end else if (tx_en && cmd == CMD_READ_MEM) begin
+            crc <= crc_next;
+        end
+    end
+
     // TX logic
     assign tx_en   = (state == STATE_SEND && cnt[1:0] == 2'b11);
     assign qspi_io = (state == STATE_SEND) ? io_out : 'z;
@@ -107,6 +144,7 @@ module qspi (
     // Start detection
     logic [2:0] start_sync, reset_sync;
     assign start = (start_sync[2:1] == 2'b10);
+    assign active = !start_sync[1];
     assign fifo_reset = (reset_sync[2:1] == 2'b10);
     always_ff @(posedge clk) begin
         start_sync <= {start_sync[1:0], qspi_ncs};
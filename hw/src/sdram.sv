@@ -1,15 +1,23 @@
 module sdram #(
     parameter ROW_BITS = 12,
-    parameter COL_BITS = 8
+    parameter COL_BITS = 8,
+    parameter OPEN_PAGE = 1,  // keep one row open per bank instead of auto-precharge
+    parameter CPU_DEADLINE = 28,  // clocks from a ch0 request until the data is needed before M2 falls
+    parameter PPU_DEADLINE = 20  // clocks from a ch1 request until the data is needed before PPU_RD rises
 ) (
     // SDRAM interface
     input logic clk,
     input logic reset,  // Reset signal
-    sdram_bus.memory ch0,  // SDRAM bus with priority 0
-    sdram_bus.memory ch1,  // SDRAM bus with priority 1
-    sdram_bus.memory ch2,  // SDRAM bus with priority 2
+    sdram_bus.memory ch0,  // CPU bus with deadline
+    sdram_bus.memory ch1,  // PPU bus with deadline
+    sdram_bus.memory ch2,  // API bus served in the slack of ch0 and ch1
     input logic refresh,  // External refresh signal
 
+    // Performance counter strobes
+    output logic [2:0] stat_wait,  // Request waits for the arbiter, per channel
+    output logic stat_refresh,  // Refresh issued
+    output logic stat_defer,  // Refresh held back for a NES request
+
     // SDRAM signals
     output logic sdram_cs,
     output logic [ROW_BITS-1:0] sdram_addr,
@@ -26,7 +34,10 @@ module sdram #(
     localparam CAS_LATENCY = 5'd2;  // 2 or 3 clocks allowed. 3 for >100MHz
     localparam READ_PERIOD = 5'd6;  // tRAS + tRP
     localparam WRITE_PERIOD = 5'd8;  // tRAS + tRP + tWR
+    localparam WRITE_RECOVERY = 2'd2;  // tWR clocks before precharge
     localparam REFRESH_INTERVAL = 11'd1560;  // tREF / 4K 15.625E-6 * FREQ
+    localparam REFRESH_GRACE = 11'd64;  // refresh may wait this long for a quiet bus
+    localparam MAX_BURST = 5'd4;  // longest burst requested by the NES buses
 
     // configure steps
     localparam CONFIGURE_PRECHARGE = PRECHARGE_PERIOD;
@@ -43,6 +54,15 @@ module sdram #(
     localparam ACTIVE_READ_END = READ_PERIOD;
     localparam ACTIVE_WRITE_END = WRITE_PERIOD;
 
+    // Worst case clocks the arbiter is busy with one job: a row miss for a
+    // CPU/PPU read, an API access and a refresh with closing of open banks.
+    localparam ACCESS_COST = WRITE_RECOVERY + PRECHARGE_PERIOD + ACTIVE_READY + MAX_BURST + 5'd1;
+    localparam API_COST = OPEN_PAGE ? ACTIVE_READY + 5'd1 : WRITE_PERIOD + 5'd1;
+    localparam REFRESH_COST = PRECHARGE_PERIOD + READ_PERIOD + 5'd1;
+    localparam logic signed [7:0] ACCESS_SLACK = 8'(ACCESS_COST);
+    localparam logic signed [7:0] API_SLACK = 8'(API_COST + ACCESS_COST);
+    localparam logic signed [7:0] REFRESH_SLACK = 8'(REFRESH_COST + ACCESS_COST);
+
     localparam CMD_NOOP = 3'b111;
     localparam CMD_ACTIVATE = 3'b011;
     localparam CMD_MODE_REGISTER_SET = 3'b000;
@@ -51,11 +71,12 @@ module sdram #(
     localparam CMD_WRITE = 3'b100;
     localparam CMD_PRECHARGE = 3'b010;
 
-    enum logic [1:0] {
+    enum logic [2:0] {
         STATE_CONFIGURE,
         STATE_IDLE,
         STATE_ACTIVE,
-        STATE_REFRESH
+        STATE_REFRESH,
+        STATE_PRECHARGE
     } state;
 
     /* verilator lint_off PROCASSINIT */
@@ -69,8 +90,90 @@ module sdram #(
     logic [1:0] curr_ch;
     logic we;
     logic [1:0] wm;
+    logic [2:0] burst;
+    logic [2:0] burst_wrap;
+    logic [COL_BITS-1:0] next_column;
     logic [2:0] pending_req;
 
+    // Open row per bank. Addresses are split as {row, bank, column} so
+    // neighbouring 2^COL_BITS word pages are interleaved over the banks.
+    logic [3:0] bank_open;
+    logic [ROW_BITS-1:0] bank_row[4];
+    logic [1:0] write_wait;
+
+    // Deadline bookkeeping for the NES buses
+    logic [5:0] cpu_age, ppu_age;
+    logic [5:0] cpu_wait, ppu_wait;
+    logic signed [7:0] cpu_slack, ppu_slack, min_slack, budget;
+    logic cpu_pending, ppu_pending, api_pending;
+    logic nes_ch;
+    logic api_fits, refresh_fits, refresh_urgent;
+
+    // Request selected by the arbiter
+    logic sel_valid;
+    logic [1:0] sel_ch;
+    logic [ROW_BITS-1:0] sel_row;
+    logic [1:0] sel_ba;
+    logic [COL_BITS-1:0] sel_col;
+    logic [15:0] sel_data;
+    logic sel_we;
+    logic [1:0] sel_wm;
+    logic [2:0] sel_burst;
+    logic sel_hit;
+
+    assign cpu_pending = ch0.req || pending_req[0];
+    assign ppu_pending = ch1.req || pending_req[1];
+    assign api_pending = ch2.req || pending_req[2];
+    assign refresh_urgent = (refresh_timer >= REFRESH_INTERVAL);
+
+    always_comb begin
+        // Clocks left until the data of each pending NES request is needed
+        cpu_wait = ch0.req ? '0 : cpu_age;
+        ppu_wait = ch1.req ? '0 : ppu_age;
+        cpu_slack = 8'(CPU_DEADLINE) - 8'(cpu_wait);
+        ppu_slack = 8'(PPU_DEADLINE) - 8'(ppu_wait);
+
+        // Earliest deadline first between CPU and PPU
+        nes_ch = ppu_pending && (!cpu_pending || ppu_slack < cpu_slack);
+        min_slack = nes_ch ? ppu_slack : cpu_slack;
+        // Both requests still have to be served after the inserted job
+        budget = min_slack - ((cpu_pending && ppu_pending) ? ACCESS_SLACK : 8'sd0);
+
+        api_fits = !(cpu_pending || ppu_pending) || budget >= API_SLACK;
+        refresh_fits = !(cpu_pending || ppu_pending) || budget >= REFRESH_SLACK;
+
+        sel_valid = cpu_pending || ppu_pending || api_pending;
+        if ((cpu_pending || ppu_pending) && !(api_pending && api_fits)) begin
+            sel_ch = nes_ch ? 2'd1 : 2'd0;
+        end else begin
+            sel_ch = 2'd2;
+        end
+
+        case (sel_ch)
+            2'd0: begin
+                {sel_row, sel_ba, sel_col} = ch0.address;
+                {sel_data, sel_we, sel_wm, sel_burst} = {ch0.data_write, ch0.we, ch0.wm, ch0.burst};
+            end
+            2'd1: begin
+                {sel_row, sel_ba, sel_col} = ch1.address;
+                {sel_data, sel_we, sel_wm, sel_burst} = {ch1.data_write, ch1.we, ch1.wm, ch1.burst};
+            end
+            default: begin
+                {sel_row, sel_ba, sel_col} = ch2.address;
+                {sel_data, sel_we, sel_wm, sel_burst} = {ch2.data_write, ch2.we, ch2.wm, ch2.burst};
+            end
+        endcase
+        sel_hit = bank_open[sel_ba] && (bank_row[sel_ba] == sel_row);
+    end
+
+    // Next column of a burst, wrapping within the aligned block
+    assign burst_wrap = burst | (burst >> 1) | (burst >> 2);
+    assign next_column = (column & ~COL_BITS'(burst_wrap)) | ((column + 1'd1) & COL_BITS'(burst_wrap));
+
+    assign stat_wait = pending_req;
+    assign stat_refresh = (state == STATE_REFRESH && step == ACTIVE_START);
+    assign stat_defer = (state == STATE_IDLE && pending_refresh && !(refresh_urgent || refresh_fits));
+
     assign {sdram_ras, sdram_cas, sdram_we} = cmd;
     assign sdram_cs = (cmd == CMD_NOOP);
     assign sdram_dq = (cmd == CMD_WRITE) ? data : 'z;
@@ -78,10 +181,16 @@ module sdram #(
     always_ff @(posedge clk) begin
         refresh_timer <= refresh_timer + 1;
 
-        if (refresh_timer >= REFRESH_INTERVAL || ((refresh_timer >= REFRESH_INTERVAL / 2) && refresh)) begin
+        if (refresh_timer >= REFRESH_INTERVAL - REFRESH_GRACE || ((refresh_timer >= REFRESH_INTERVAL / 2) && refresh)) begin
             pending_refresh <= 1;
         end
 
+        // Age of the outstanding NES requests, saturating
+        cpu_age <= ch0.req ? 6'd1 : (cpu_age != '1 ? cpu_age + 6'd1 : cpu_age);
+        ppu_age <= ch1.req ? 6'd1 : (ppu_age != '1 ? ppu_age + 6'd1 : ppu_age);
+
+        if (write_wait != 0) write_wait <= write_wait - 1;
+
         pending_req <= pending_req | {ch2.req, ch1.req, ch0.req};
         {ch2.ack, ch1.ack, ch0.ack} <= '0;
 
@@ -90,6 +199,8 @@ module sdram #(
             cmd <= CMD_NOOP;
             step <= '0;
             pending_req <= 3'b000;
+            bank_open <= '0;
+            write_wait <= '0;
         end else begin
             case (state)
                 STATE_CONFIGURE: begin
@@ -128,78 +239,131 @@ module sdram #(
                     step <= ACTIVE_START;
                     sdram_dqm <= 2'b11;
 
-                    // prioritize refresh over requests
-                    if (pending_refresh) begin
-                        pending_refresh <= 0;
-                        refresh_timer <= '0;
-                        cmd <= CMD_AUTO_REFRESH;
-                        state <= STATE_REFRESH;
-                    end else if (ch0.req || pending_req[0]) begin
-                        {sdram_ba, column, sdram_addr} <= ch0.address;
-                        data <= ch0.data_write;
-                        cmd <= CMD_ACTIVATE;
-                        state <= STATE_ACTIVE;
-                        curr_ch <= 2'd0;
-                        we <= ch0.we;
-                        wm <= ch0.wm;
-                        pending_req[0] <= 1'b0;
-                    end else if (ch1.req || pending_req[1]) begin
-                        {sdram_ba, column, sdram_addr} <= ch1.address;
-                        data <= ch1.data_write;
-                        cmd <= CMD_ACTIVATE;
-                        state <= STATE_ACTIVE;
-                        curr_ch <= 2'd1;
-                        we <= ch1.we;
-                        wm <= ch1.wm;
-                        pending_req[1] <= 1'b0;
-                    end else if (ch2.req || pending_req[2]) begin
-                        {sdram_ba, column, sdram_addr} <= ch2.address;
-                        data <= ch2.data_write;
-                        cmd <= CMD_ACTIVATE;
-                        state <= STATE_ACTIVE;
-                        curr_ch <= 2'd2;
-                        we <= ch2.we;
-                        wm <= ch2.wm;
-                        pending_req[2] <= 1'b0;
+                    // Refresh waits for slack unless it is overdue
+                    if (pending_refresh && (refresh_urgent || refresh_fits)) begin
+                        if (bank_open != 0) begin
+                            // Refresh requires all banks to be idle
+                            if (write_wait == 0) begin
+                                sdram_addr[10] <= 1'b1;  // precharge all banks
+                                cmd <= CMD_PRECHARGE;
+                                bank_open <= '0;
+                                state <= STATE_PRECHARGE;
+                            end
+                        end else begin
+                            pending_refresh <= 0;
+                            refresh_timer <= '0;
+                            cmd <= CMD_AUTO_REFRESH;
+                            state <= STATE_REFRESH;
+                        end
+                    end else if (sel_valid) begin
+                        if (sel_hit) begin
+                            // Row hit: skip ACTIVATE
+                            sdram_addr <= {{ROW_BITS - COL_BITS{1'b0}}, sel_col};
+                            sdram_addr[10] <= 1'b0;
+                            sdram_ba <= sel_ba;
+                            sdram_dqm <= sel_we ? sel_wm : 2'b00;
+                            data <= sel_data;
+                            cmd <= sel_we ? CMD_WRITE : CMD_READ;
+                            column <= sel_col;
+                            curr_ch <= sel_ch;
+                            we <= sel_we;
+                            burst <= sel_we ? 3'd0 : sel_burst;
+                            pending_req[sel_ch] <= 1'b0;
+
+                            if (sel_we) begin
+                                // Writes complete with the command itself
+                                write_wait <= WRITE_RECOVERY;
+                                case (sel_ch)
+                                    2'd0: ch0.ack <= 1;
+                                    2'd1: ch1.ack <= 1;
+                                    2'd2: ch2.ack <= 1;
+                                    default;
+                                endcase
+                            end else begin
+                                step <= ACTIVE_CMD + 5'd1;
+                                state <= STATE_ACTIVE;
+                            end
+                        end else if (bank_open[sel_ba]) begin
+                            // Row miss: close the bank, the request is served after tRP
+                            if (write_wait == 0) begin
+                                sdram_addr[10] <= 1'b0;  // precharge the selected bank
+                                sdram_ba <= sel_ba;
+                                cmd <= CMD_PRECHARGE;
+                                bank_open[sel_ba] <= 1'b0;
+                                state <= STATE_PRECHARGE;
+                            end
+                        end else begin
+                            sdram_addr <= sel_row;
+                            sdram_ba <= sel_ba;
+                            column <= sel_col;
+                            data <= sel_data;
+                            cmd <= CMD_ACTIVATE;
+                            state <= STATE_ACTIVE;
+                            curr_ch <= sel_ch;
+                            we <= sel_we;
+                            wm <= sel_wm;
+                            burst <= sel_we ? 3'd0 : sel_burst;
+                            pending_req[sel_ch] <= 1'b0;
+                            if (OPEN_PAGE) begin
+                                bank_open[sel_ba] <= 1'b1;
+                                bank_row[sel_ba] <= sel_row;
+                            end
+                        end
                     end
                 end
                 STATE_ACTIVE: begin
                     step <= step + 1;
+                    cmd  <= CMD_NOOP;
 
-                    case (step)
-                        ACTIVE_CMD: begin
-                            sdram_addr <= {{ROW_BITS - COL_BITS{1'b0}}, column};
-                            sdram_addr[10] <= 1'b1;  // Auto-precharge
-                            sdram_dqm <= we ? wm : 2'b00;
-                            cmd <= we ? CMD_WRITE : CMD_READ;
-                        end
-                        ACTIVE_READY: begin
-                            case (curr_ch)
-                                2'd0: begin
-                                    if (!we) ch0.data_read <= sdram_dq;
-                                    ch0.ack <= 1;
-                                end
-                                2'd1: begin
-                                    if (!we) ch1.data_read <= sdram_dq;
-                                    ch1.ack <= 1;
-                                end
-                                2'd2: begin
-                                    if (!we) ch2.data_read <= sdram_dq;
-                                    ch2.ack <= 1;
-                                end
-                                default;
-                            endcase
-                        end
-                        ACTIVE_READ_END: if (!we) state <= STATE_IDLE;
-                        ACTIVE_WRITE_END: if (we) state <= STATE_IDLE;
-                        default: cmd <= CMD_NOOP;
-                    endcase
+                    if (step == ACTIVE_CMD) begin
+                        sdram_addr <= {{ROW_BITS - COL_BITS{1'b0}}, column};
+                        sdram_addr[10] <= !OPEN_PAGE && burst == 0;  // Auto-precharge
+                        sdram_dqm <= we ? wm : 2'b00;
+                        cmd <= we ? CMD_WRITE : CMD_READ;
+                    end else if (step > ACTIVE_CMD && step <= ACTIVE_CMD + 5'(burst)) begin
+                        // Back to back reads of the following columns, wrapping within the burst block
+                        column <= next_column;
+                        sdram_addr <= {{ROW_BITS - COL_BITS{1'b0}}, next_column};
+                        sdram_addr[10] <= !OPEN_PAGE && step == ACTIVE_CMD + 5'(burst);
+                        cmd <= CMD_READ;
+                    end
+
+                    // One acknowledge per word, the requested word comes first
+                    if (step >= ACTIVE_READY && step <= ACTIVE_READY + 5'(burst)) begin
+                        case (curr_ch)
+                            2'd0: begin
+                                if (!we) ch0.data_read <= sdram_dq;
+                                ch0.ack <= 1;
+                            end
+                            2'd1: begin
+                                if (!we) ch1.data_read <= sdram_dq;
+                                ch1.ack <= 1;
+                            end
+                            2'd2: begin
+                                if (!we) ch2.data_read <= sdram_dq;
+                                ch2.ack <= 1;
+                            end
+                            default;
+                        endcase
+                    end
+
+                    // tRAS and tWR are already met when the row stays open
+                    if (OPEN_PAGE && step == ACTIVE_READY + 5'(burst)) state <= STATE_IDLE;
+                    if (!OPEN_PAGE && !we && step == ACTIVE_READ_END + 5'(burst)) state <= STATE_IDLE;
+                    if (!OPEN_PAGE && we && step == ACTIVE_WRITE_END) state <= STATE_IDLE;
                 end
                 STATE_REFRESH: begin
                     cmd  <= CMD_NOOP;
                     step <= step + 1;
                     if (step == READ_PERIOD) state <= STATE_IDLE;
                 end
+                STATE_PRECHARGE: begin
+                    cmd  <= CMD_NOOP;
+                    step <= step + 1;
+                    // ACTIVATE or AUTO_REFRESH may follow tRP after the precharge
+                    if (step == PRECHARGE_PERIOD - 5'd1) state <= STATE_IDLE;
+                end
+                default;
             endcase
         end
     end
@@ -5,10 +5,11 @@ interface sdram_bus #(
     logic ack;
     logic we;  // write enable
     logic [1:0] wm;  // write mask
+    logic [2:0] burst;  // extra words to read, wrapping within the aligned power of two block holding them
     logic [ADDR_BITS-1:0] address;
     logic [15:0] data_read;
     logic [15:0] data_write;
 
-    modport memory(input req, we, wm, address, data_write, output ack, data_read);
-    modport controller(input ack, data_read, output req, we, wm, address, data_write);
+    modport memory(input req, we, wm, burst, address, data_write, output ack, data_read);
+    modport controller(input ack, data_read, output req, we, wm, burst, address, data_write);
 endinterface
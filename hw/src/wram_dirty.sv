@@ -0,0 +1,28 @@
+// WRAM pages written by the CPU since the last snapshot. The firmware takes a snapshot
+// before a battery save, so writes that land during the save are kept for the next one.
+module wram_dirty #(
+    parameter PAGES = 128
+) (
+    input logic clk,
+
+    input logic written,
+    input logic [$clog2(PAGES)-1:0] page,
+    input logic snap,  // Move the bitmap into the readable snapshot
+    input logic [1:0] sel,
+    output logic [31:0] value
+);
+    logic [PAGES-1:0] dirty, snapshot;
+
+    // Not registered, api.sv sends the word on the clock after it latches sel
+    assign value = snapshot[sel*32+:32];
+
+    always_ff @(posedge clk) begin
+        if (snap) begin
+            snapshot <= dirty;
+            dirty <= '0;
+            if (written) dirty[page] <= 1'b1;
+        end else if (written) begin
+            dirty[page] <= 1'b1;
+        end
+    end
+endmodule
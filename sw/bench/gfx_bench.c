@@ -0,0 +1,155 @@
+// Times a full launcher menu redraw with gfx.c against the per-pixel drawing it
+// replaced, and checks that both render the same frame
+#include "gfx.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SCREEN_WIDTH 256
+#define SCREEN_HEIGHT 240
+#define FB_SIZE (SCREEN_WIDTH * SCREEN_HEIGHT / 8U * 2)
+#define FRAME_SIZE (1U << 14)
+#define MENU_ROWS 26
+#define MENU_COLS 30
+#define FRAMES 1000
+#define ROUNDS 10
+
+extern uint8_t vram[];
+extern const uint8_t font8x8[][8]; // Defined by gfx.c
+
+static uint8_t ref_fb[FB_SIZE];
+
+static void ref_pixel(uint16_t x, uint16_t y, uint8_t color)
+{
+    if (x >= SCREEN_WIDTH || y >= SCREEN_HEIGHT) {
+        return;
+    }
+    uint32_t tile_idx = (y / 8 * 32) + (x / 8);
+    uint32_t fb_idx = (tile_idx * 16) + (y % 8);
+    uint8_t bitmask = 128U >> (x % 8);
+    ref_fb[fb_idx] &= ~bitmask;
+    if (color & 0x01) {
+        ref_fb[fb_idx] |= bitmask;
+    }
+
+    fb_idx += 8;
+    ref_fb[fb_idx] &= ~bitmask;
+    if (color & 0x02) {
+        ref_fb[fb_idx] |= bitmask;
+    }
+}
+
+static void ref_text(uint16_t x, uint16_t y, const char *str, int len, uint8_t color)
+{
+    int i = 0;
+    while (*str) {
+        if (len > 0 && i++ >= len) {
+            break;
+        }
+
+        char c = *str++;
+        if (c < 32 || c > 127) {
+            c = '?';
+        }
+
+        const uint8_t *char_bitmap = font8x8[c - 32];
+        for (int row = 0; row < 8; row++) {
+            for (int col = 0; col < 8; col++) {
+                if (char_bitmap[row] & 1 << col) {
+                    ref_pixel(x + col, y + row, color);
+                }
+            }
+        }
+        x += 8;
+    }
+}
+
+static void ref_fill_rect(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t color)
+{
+    for (uint16_t i = 0; i < h; i++) {
+        for (uint16_t j = 0; j < w; j++) {
+            ref_pixel(x + j, y + i, color);
+        }
+    }
+}
+
+// The file list as ui.c draws it, with the cursor bar on one row
+static void menu(void (*text)(uint16_t, uint16_t, const char *, int, uint8_t),
+    void (*fill_rect)(uint16_t, uint16_t, uint16_t, uint16_t, uint8_t), const char *line)
+{
+    for (int r = 0; r < MENU_ROWS; r++) {
+        if (r == 3) {
+            fill_rect(8, (r + 2) * 8, MENU_COLS * 8, 8, 3);
+        }
+        text(8, (r + 2) * 8, line, MENU_COLS, 1);
+    }
+}
+
+// Best of several rounds, to keep other host load out of the figure
+static double time_menu(void (*text)(uint16_t, uint16_t, const char *, int, uint8_t),
+    void (*fill_rect)(uint16_t, uint16_t, uint16_t, uint16_t, uint8_t), const char *line)
+{
+    double best = 0;
+    for (int round = 0; round < ROUNDS; round++) {
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (int f = 0; f < FRAMES; f++) {
+            menu(text, fill_rect, line);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        double us = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / 1e3 / FRAMES;
+        if (round == 0 || us < best) {
+            best = us;
+        }
+    }
+    return best;
+}
+
+// Random clipped strings and rectangles must land on the same pixels
+static int check(void)
+{
+    srand(1);
+    for (int k = 0; k < 100000; k++) {
+        uint16_t x = rand() % 300, y = rand() % 260;
+        uint8_t color = rand() % 4;
+        if (rand() % 2) {
+            char s[8];
+            for (int i = 0; i < 7; i++) {
+                s[i] = 32 + rand() % 96;
+            }
+            s[7] = '\0';
+            int len = rand() % 9 - 1;
+            gfx_text(x, y, s, len, color);
+            ref_text(x, y, s, len, color);
+        } else {
+            uint16_t w = rand() % 300, h = rand() % 100;
+            gfx_fill_rect(x, y, w, h, color);
+            ref_fill_rect(x, y, w, h, color);
+        }
+    }
+
+    // The back buffer holds the frame once it is shown
+    gfx_refresh();
+    return memcmp(&vram[FRAME_SIZE], ref_fb, FB_SIZE) == 0 ? 0 : -1;
+}
+
+int main()
+{
+    if (check() != 0) {
+        fprintf(stderr, "gfx output differs from the per-pixel reference\n");
+        return 1;
+    }
+
+    char line[MENU_COLS + 1];
+    for (int i = 0; i < MENU_COLS; i++) {
+        line[i] = 'A' + i % 26;
+    }
+    line[MENU_COLS] = '\0';
+
+    double per_pixel = time_menu(ref_text, ref_fill_rect, line);
+    double per_row = time_menu(gfx_text, gfx_fill_rect, line);
+    printf("menu redraw (%d rows): per-pixel %.1f us, per-row %.1f us, %.1fx\n", MENU_ROWS, per_pixel, per_row,
+        per_pixel / per_row);
+    return 0;
+}
@@ -0,0 +1,37 @@
+#include "fpga_api.h"
+#include <qspi.h>
+#include <string.h>
+
+#define FB_ADDR 0x7D8000
+#define VRAM_SIZE (2U << 14) // Both launcher frames
+
+// Launcher frames as the mapper would see them
+uint8_t vram[VRAM_SIZE];
+
+int qspi_write(uint8_t cmd, uint32_t address, const uint8_t *data, uint32_t size)
+{
+    if (cmd == CMD_WRITE_MEM && address >= FB_ADDR && address - FB_ADDR + size <= VRAM_SIZE) {
+        memcpy(&vram[address - FB_ADDR], data, size);
+    }
+    return 0;
+}
+
+int fpga_api_write_mem(uint32_t address, uint32_t size, fpga_api_reader_cb cb, void *arg)
+{
+    uint8_t buf[256];
+    (void)address;
+    for (uint32_t n; size > 0; size -= n) {
+        n = size < sizeof(buf) ? size : sizeof(buf);
+        if (!cb(buf, n, arg)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int fpga_api_write_reg(enum fpga_reg_id id, uint32_t value)
+{
+    (void)id;
+    (void)value;
+    return 0;
+}
@@ -1,6 +1,7 @@
 #include "diskio.h"
 #include "internal.h"
 #include "log.h"
+#include <string.h>
 
 #ifdef ENABLE_SD_FS
 
@@ -8,9 +9,40 @@ LOG_MODULE(diskio);
 
 #define SD_TIMEOUT 10 * 1000U
 #define SD_DEFAULT_BLOCK_SIZE 512
+#define SD_SWITCH_STATUS_SIZE 64
+#define SD_CHECK_HIGH_SPEED 0x00FFFFF1U // CMD6 mode 0, access mode function 1
+#define SD_SET_HIGH_SPEED 0x80FFFFF1U // CMD6 mode 1, access mode function 1
+#define SD_CRC_ERRORS (SDMMC_ERROR_CMD_CRC_FAIL | SDMMC_ERROR_DATA_CRC_FAIL)
+
+// Single sector reads are FAT and directory lookups, keep the recent ones
+#ifndef SD_CACHE_SECTORS
+#define SD_CACHE_SECTORS 8
+#endif
+
+struct cache_entry {
+    bool valid;
+    LBA_t sector;
+    uint32_t used;
+};
 
 static volatile bool transmit;
 static bool initialized = false;
+static bool high_speed = false;
+static bool retry; // Transfer failed at high speed and is worth repeating
+
+#if SD_CACHE_SECTORS > 0
+static struct cache_entry cache[SD_CACHE_SECTORS];
+static uint8_t cache_data[SD_CACHE_SECTORS][SD_DEFAULT_BLOCK_SIZE] __attribute__((aligned(4)));
+static uint32_t cache_clock;
+#endif
+
+static void sd_high_speed();
+static bool sd_fallback(uint32_t status);
+static DRESULT sd_read(BYTE *buff, LBA_t sector, UINT count);
+static DRESULT sd_write(const BYTE *buff, LBA_t sector, UINT count);
+static void cache_invalidate();
+static DRESULT cache_read(BYTE *buff, LBA_t sector);
+static void cache_update(const BYTE *buff, LBA_t sector, UINT count);
 
 static inline bool is_transfer_state()
 {
@@ -48,6 +80,8 @@ DSTATUS disk_initialize(BYTE pdrv)
     if (initialized) {
         HAL_SD_DeInit(&p->hsdio);
     }
+    // The card may have been swapped
+    cache_invalidate();
 
     if ((rc = HAL_SD_Init(&p->hsdio)) != HAL_OK) {
         LOG_ERR("HAL_SD_Init() failed: %d", rc);
@@ -60,25 +94,63 @@ DSTATUS disk_initialize(BYTE pdrv)
     }
     initialized = true;
 
-    return wait_transfer_state(SD_TIMEOUT) ? 0 : STA_NOINIT;
+    if (!wait_transfer_state(SD_TIMEOUT)) {
+        return STA_NOINIT;
+    }
+    sd_high_speed();
+    return 0;
 }
 
 DRESULT disk_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count)
+{
+    UNUSED(pdrv);
+
+    if (count == 1) {
+        return cache_read(buff, sector);
+    }
+    return sd_read(buff, sector, count);
+}
+
+static DRESULT sd_read(BYTE *buff, LBA_t sector, UINT count)
+{
+    DRESULT rc;
+
+    do {
+        retry = false;
+        if ((rc = disk_read_begin(0, buff, sector, count)) == RES_OK) {
+            rc = disk_read_end(0);
+        }
+    } while (rc != RES_OK && retry);
+    return rc;
+}
+
+DRESULT disk_read_begin(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count)
 {
     UNUSED(pdrv);
     struct peripherals *p = get_peripherals();
     HAL_StatusTypeDef rc;
 
+    // The card leaves the data state once the previous transfer is stopped,
+    // so this is the only state poll per transfer
     if (!wait_transfer_state(SD_TIMEOUT)) {
         LOG_ERR("Timeout waiting for SD transfer state");
         return RES_ERROR;
     }
 
+    // Multiple blocks are read with CMD18 and stopped with CMD12 on completion
     transmit = true;
     if ((rc = HAL_SD_ReadBlocks_DMA(&p->hsdio, buff, sector, count)) != HAL_OK) {
+        transmit = false;
         LOG_ERR("SD start read failed: %d", rc);
         return RES_ERROR;
     }
+    return RES_OK;
+}
+
+DRESULT disk_read_end(BYTE pdrv)
+{
+    UNUSED(pdrv);
+    struct peripherals *p = get_peripherals();
 
     // wait until the read operation is finished
     uint32_t start = HAL_GetTick();
@@ -92,20 +164,32 @@ DRESULT disk_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count)
     uint32_t status = HAL_SD_GetError(&p->hsdio);
     if (status != SDMMC_ERROR_NONE) {
         LOG_ERR("SD read error: 0x%X", status);
+        retry = sd_fallback(status);
         return RES_ERROR;
     }
-
-    if (!wait_transfer_state(SD_TIMEOUT)) {
-        LOG_ERR("Timeout waiting for SD transfer state");
-        return RES_ERROR;
-    }
-
     return RES_OK;
 }
 
 DRESULT disk_write(BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count)
 {
     UNUSED(pdrv);
+    DRESULT rc;
+
+    // Write through, cached copies stay valid only if the card took the data
+    do {
+        retry = false;
+        rc = sd_write(buff, sector, count);
+    } while (rc != RES_OK && retry);
+    if (rc == RES_OK) {
+        cache_update(buff, sector, count);
+    } else {
+        cache_invalidate();
+    }
+    return rc;
+}
+
+static DRESULT sd_write(const BYTE *buff, LBA_t sector, UINT count)
+{
     struct peripherals *p = get_peripherals();
     HAL_StatusTypeDef rc;
 
@@ -132,6 +216,7 @@ DRESULT disk_write(BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count)
     uint32_t status = HAL_SD_GetError(&p->hsdio);
     if (status != SDMMC_ERROR_NONE) {
         LOG_ERR("SD write error: 0x%X", status);
+        retry = sd_fallback(status);
         return RES_ERROR;
     }
 
@@ -154,7 +239,7 @@ DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void *buff)
     }
 
     switch (cmd) {
-    // Make sure that no pending write process
+    // Make sure that no pending write process, the cache is write through
     case CTRL_SYNC:
         return RES_OK;
 
@@ -202,6 +287,166 @@ DWORD get_fattime()
     return attime;
 }
 
+#if SD_CACHE_SECTORS > 0
+static void cache_invalidate()
+{
+    for (uint32_t i = 0; i < SD_CACHE_SECTORS; i++) {
+        cache[i].valid = false;
+    }
+}
+
+static DRESULT cache_read(BYTE *buff, LBA_t sector)
+{
+    uint32_t victim = 0;
+    DRESULT rc;
+
+    for (uint32_t i = 0; i < SD_CACHE_SECTORS; i++) {
+        if (cache[i].valid && cache[i].sector == sector) {
+            cache[i].used = ++cache_clock;
+            memcpy(buff, cache_data[i], SD_DEFAULT_BLOCK_SIZE);
+            return RES_OK;
+        }
+        // Least recently used entry, free ones first
+        if (cache[victim].valid && (!cache[i].valid || cache[i].used < cache[victim].used)) {
+            victim = i;
+        }
+    }
+
+    cache[victim].valid = false;
+    if ((rc = sd_read(cache_data[victim], sector, 1)) != RES_OK) {
+        return rc;
+    }
+    cache[victim].valid = true;
+    cache[victim].sector = sector;
+    cache[victim].used = ++cache_clock;
+    memcpy(buff, cache_data[victim], SD_DEFAULT_BLOCK_SIZE);
+    return RES_OK;
+}
+
+static void cache_update(const BYTE *buff, LBA_t sector, UINT count)
+{
+    for (uint32_t i = 0; i < SD_CACHE_SECTORS; i++) {
+        if (cache[i].valid && cache[i].sector >= sector && cache[i].sector - sector < count) {
+            memcpy(cache_data[i], buff + (cache[i].sector - sector) * SD_DEFAULT_BLOCK_SIZE, SD_DEFAULT_BLOCK_SIZE);
+        }
+    }
+}
+#else
+static void cache_invalidate() { }
+
+static DRESULT cache_read(BYTE *buff, LBA_t sector)
+{
+    return sd_read(buff, sector, 1);
+}
+
+static void cache_update(const BYTE *buff, LBA_t sector, UINT count)
+{
+    UNUSED(buff);
+    UNUSED(sector);
+    UNUSED(count);
+}
+#endif
+
+// CMD6 switch function, the card answers with a 512 bit status block
+static bool sd_switch(uint32_t arg, uint8_t *status)
+{
+    struct peripherals *p = get_peripherals();
+    SD_HandleTypeDef *hsd = &p->hsdio;
+    SDIO_DataInitTypeDef config = {
+        .DataTimeOut = SDMMC_DATATIMEOUT,
+        .DataLength = SD_SWITCH_STATUS_SIZE,
+        .DataBlockSize = SDIO_DATABLOCK_SIZE_64B,
+        .TransferDir = SDIO_TRANSFER_DIR_TO_SDIO,
+        .TransferMode = SDIO_TRANSFER_MODE_BLOCK,
+        .DPSM = SDIO_DPSM_ENABLE,
+    };
+    uint32_t words[SD_SWITCH_STATUS_SIZE / 4] = {0};
+    uint32_t index = 0;
+    bool ok = false;
+
+    if (SDMMC_CmdBlockLength(hsd->Instance, SD_SWITCH_STATUS_SIZE) != SDMMC_ERROR_NONE) {
+        return false;
+    }
+    hsd->Instance->DCTRL = 0;
+    (void)SDIO_ConfigData(hsd->Instance, &config);
+
+    if (SDMMC_CmdSwitch(hsd->Instance, arg) == SDMMC_ERROR_NONE) {
+        uint32_t start = HAL_GetTick();
+        ok = true;
+        while (!__HAL_SD_GET_FLAG(hsd, SDIO_FLAG_RXOVERR | SDIO_FLAG_DCRCFAIL | SDIO_FLAG_DTIMEOUT | SDIO_FLAG_DBCKEND)) {
+            if (__HAL_SD_GET_FLAG(hsd, SDIO_FLAG_RXDAVL) && index < SD_SWITCH_STATUS_SIZE / 4) {
+                words[index++] = SDIO_ReadFIFO(hsd->Instance);
+            }
+            if (HAL_GetTick() - start > SD_TIMEOUT) {
+                ok = false;
+                break;
+            }
+        }
+        while (__HAL_SD_GET_FLAG(hsd, SDIO_FLAG_RXDAVL) && index < SD_SWITCH_STATUS_SIZE / 4) {
+            words[index++] = SDIO_ReadFIFO(hsd->Instance);
+        }
+        if (__HAL_SD_GET_FLAG(hsd, SDIO_FLAG_RXOVERR | SDIO_FLAG_DCRCFAIL | SDIO_FLAG_DTIMEOUT)) {
+            ok = false;
+        }
+    }
+    __HAL_SD_CLEAR_FLAG(hsd, SDIO_STATIC_DATA_FLAGS);
+    (void)SDMMC_CmdBlockLength(hsd->Instance, SD_DEFAULT_BLOCK_SIZE);
+
+    // FIFO words hold the status bytes in transfer order
+    memcpy(status, words, sizeof(words));
+    return ok && index == SD_SWITCH_STATUS_SIZE / 4;
+}
+
+static void set_high_speed(bool enable)
+{
+    struct peripherals *p = get_peripherals();
+
+    // In high speed mode SDIO_CK runs straight from the 48 MHz kernel clock. Only the bypass
+    // bit changes, hsdio.Init still describes the 1-bit identification setup and a full
+    // SDIO_Init() would drop the host out of 4-bit mode.
+    MODIFY_REG(p->hsdio.Instance->CLKCR, SDIO_CLKCR_BYPASS, enable ? SDIO_CLOCK_BYPASS_ENABLE : SDIO_CLOCK_BYPASS_DISABLE);
+    high_speed = enable;
+}
+
+static void sd_high_speed()
+{
+    static uint32_t probe[SD_DEFAULT_BLOCK_SIZE / 4];
+    uint8_t status[SD_SWITCH_STATUS_SIZE];
+
+    set_high_speed(false);
+
+    // Function group 1 support bits are 415:400, function 1 is high speed
+    if (!sd_switch(SD_CHECK_HIGH_SPEED, status) || !(status[13] & 0x02)) {
+        LOG_INF("SD card has no high speed mode");
+        return;
+    }
+    // Selected group 1 function is reported in bits 379:376
+    if (!sd_switch(SD_SET_HIGH_SPEED, status) || (status[16] & 0x0F) != 1) {
+        LOG_ERR("SD high speed switch failed");
+        return;
+    }
+    set_high_speed(true);
+
+    // Read back a sector at the new clock
+    if (disk_read(0, (BYTE *)probe, 0, 1) != RES_OK || !high_speed) {
+        LOG_ERR("SD high speed readback failed");
+        set_high_speed(false);
+        return;
+    }
+    LOG_INF("SD card in high speed mode");
+}
+
+// Drop back to default speed if high speed transfers fail with CRC errors
+static bool sd_fallback(uint32_t status)
+{
+    if (!high_speed || !(status & SD_CRC_ERRORS)) {
+        return false;
+    }
+    LOG_ERR("SD CRC errors, falling back to default speed");
+    set_high_speed(false);
+    return true;
+}
+
 void HAL_SD_TxCpltCallback(SD_HandleTypeDef *hsd)
 {
     UNUSED(hsd);
@@ -34,6 +34,10 @@ DRESULT disk_read (BYTE pdrv, BYTE* buff, LBA_t sector, UINT count);
 DRESULT disk_write (BYTE pdrv, const BYTE* buff, LBA_t sector, UINT count);
 DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void* buff);
 
+/* Split read, the DMA transfer runs between begin and end (fcart extension) */
+DRESULT disk_read_begin (BYTE pdrv, BYTE* buff, LBA_t sector, UINT count);
+DRESULT disk_read_end (BYTE pdrv);
+
 
 /* Disk Status Bits (DSTATUS) */
 
@@ -0,0 +1,5 @@
+#pragma once
+
+#include <stdint.h>
+
+uint32_t crc32_update(uint32_t crc, const uint8_t *data, uint32_t size);
@@ -1,6 +1,7 @@
 #include "dirlist.h"
 #include "fpga_api.h"
 #include "gfx.h"
+#include "msc.h"
 #include <errno.h>
 #include <ff.h>
 #include <qspi.h>
@@ -8,6 +9,16 @@
 #include <stdlib.h>
 #include <string.h>
 
+#define INDEX_NAME ".fcart.idx"
+#define INDEX_MAGIC 0x33444946 // "FID3"
+#define SORT_WINDOW 32 // Name bytes fetched per entry when prefixes tie
+#define SORT_RUN_MAX 256 // Longest run sorted in one piece, longer ones are merged from chunks
+#define LOAD_STEP 32 // Directory entries read per dirlist_poll()
+#define ROW_SIZE sizeof(struct dirlist_row)
+#define ROW_BATCH 16 // Rows written to SDRAM per transfer
+#define SAVE_CHUNK 4096 // Index bytes written per dirlist_poll()
+#define MERGE_STEP 64 // Entries of a long run merged per dirlist_poll()
+
 struct arr {
     uint32_t *items;
     uint16_t capacity;
@@ -25,6 +36,7 @@ struct arr {
 
 static struct arr items;
 static uint16_t dir_count;
+static uint32_t rows_addr; // Display rows in sorted order, a page is one read
 static char *curr_path;
 
 typedef struct {
@@ -33,8 +45,89 @@ typedef struct {
     uint8_t is_dir;
 } cached_entry_t;
 
+// Sorted listing saved next to the entries it describes. It is followed by the
+// SDRAM address of every name in sorted order and the names and display rows
+// as laid out in SDRAM.
+struct dir_index {
+    uint32_t magic;
+    uint16_t count;
+    uint16_t dir_count;
+    WORD fdate;
+    WORD ftime;
+    uint32_t hash;
+    uint32_t rows_addr;
+    uint32_t names_size;
+};
+
+// Entry of a run with equal prefixes and the next window of its name
+struct window_entry {
+    uint32_t addr;
+    char window[SORT_WINDOW];
+};
+
+// Sorted chunk of a long run and the rest of the name of its first unmerged entry
+struct merge_head {
+    uint16_t pos;
+    uint16_t end;
+    char name[FF_MAX_LFN + 1];
+};
+
+enum load_stage {
+    LOAD_IDLE,
+    LOAD_BUILD, // Copy names to SDRAM and hash them to validate the index
+    LOAD_SORT, // Resolve runs of equal prefixes front to back
+    LOAD_SAVE, // Write the index of the listed directory
+};
+
+// Listing in progress, advanced by dirlist_poll() a few entries at a time
+static struct {
+    enum load_stage stage;
+    DIR dir;
+    struct dir_index index;
+    bool index_fresh; // A saved index matches the directory stamp
+    struct {
+        cached_entry_t *items;
+        uint16_t capacity;
+        uint16_t count;
+    } entries;
+    uint32_t sdram_addr;
+    uint16_t buf_len;
+    uint16_t settled; // Leading entries already in their final position
+    uint16_t rows; // Settled entries with their display row written
+    // Run longer than SORT_RUN_MAX, its chunks are sorted and then merged a few
+    // entries per poll. The run settles once the merge is done.
+    struct {
+        struct merge_head *heads;
+        uint32_t *merged;
+        uint16_t start;
+        uint16_t count;
+        uint16_t chunks;
+        uint16_t sorted; // Chunks sorted so far
+        uint16_t out; // Entries merged so far
+    } merge;
+    FIL fp; // Index being saved
+    char *save_path;
+    uint32_t save_ofs; // Bytes of the table and the names written so far
+} load;
+
 static int names_cmp(const void *a, const void *b);
-static int readdir();
+static int window_cmp(const void *a, const void *b);
+static int sort_run(cached_entry_t *entries, uint16_t count, uint16_t offset);
+static int start_merge(uint16_t start, uint16_t count);
+static int merge_step();
+static void free_merge();
+static int start_load();
+static void abort_load();
+static int build_step();
+static int sort_step();
+static int write_rows(uint16_t end);
+static bool is_listed(const FILINFO *fno);
+static bool index_fresh(const struct dir_index *expect);
+static int load_index(const struct dir_index *expect);
+static void start_save(uint32_t names_size);
+static int save_step();
+static void drop_save();
+static char *index_path();
 
 int dirlist_load()
 {
@@ -44,7 +137,7 @@ int dirlist_load()
     curr_path = malloc(1);
     curr_path[0] = '\0';
 
-    return readdir();
+    return start_load();
 }
 
 int dirlist_push(const char *subdir)
@@ -63,7 +156,7 @@ int dirlist_push(const char *subdir)
     free(curr_path);
     curr_path = new_curr_path;
 
-    return readdir();
+    return start_load();
 }
 
 int dirlist_pop()
@@ -74,31 +167,69 @@ int dirlist_pop()
     } else {
         curr_path[0] = '\0';
     }
-    return readdir();
+    return start_load();
+}
+
+int dirlist_poll()
+{
+    int r;
+
+    switch (load.stage) {
+    case LOAD_BUILD:
+        r = build_step();
+        break;
+    case LOAD_SORT:
+        r = sort_step();
+        break;
+    case LOAD_SAVE:
+        r = save_step();
+        break;
+    default:
+        return 0;
+    }
+    if (r != 0) {
+        abort_load();
+        return r;
+    }
+    return load.stage != LOAD_IDLE;
 }
 
 uint16_t dirlist_size()
 {
-    return items.count;
+    // Entries past the settled ones may still move while the listing loads
+    return load.stage == LOAD_IDLE || load.stage == LOAD_SAVE ? items.count : load.rows;
 }
 
-uint8_t dirlist_select(uint16_t index, uint8_t limit, struct dirlist_entry *out)
+uint8_t dirlist_select(uint16_t index, uint8_t limit, struct dirlist_row *out)
 {
-    if (index >= items.count) {
+    uint16_t size = dirlist_size();
+    if (index >= size) {
         return 0; // Index out of bounds
     }
 
-    uint8_t count = 0;
-    uint16_t curr_index = index;
+    // Rows are stored back to back, the whole range is a single burst
+    uint8_t count = size - index < limit ? size - index : limit;
+    if (qspi_read(CMD_READ_MEM, rows_addr + index * ROW_SIZE, (uint8_t *)out, count * ROW_SIZE) != 0) {
+        return 0;
+    }
+    return count; // Return number of entries filled
+}
 
-    while ((count < limit) && (curr_index < items.count)) {
-        qspi_read(CMD_READ_MEM, items.items[curr_index], (uint8_t *)out[count].name, sizeof(out[count].name));
-        out[count].is_dir = (curr_index < dir_count);
+int dirlist_get(uint16_t index, struct dirlist_entry *out)
+{
+    if (index >= dirlist_size()) {
+        return -EINVAL;
+    }
 
-        count++;
-        curr_index++;
+    uint32_t addr;
+    if (load.stage == LOAD_IDLE || load.stage == LOAD_SAVE) {
+        addr = items.items[index];
+        out->is_dir = (index < dir_count);
+    } else {
+        addr = load.entries.items[index].addr;
+        out->is_dir = load.entries.items[index].is_dir;
     }
-    return count; // Return number of entries filled
+    return qspi_read(CMD_READ_MEM, addr, (uint8_t *)out->name, sizeof(out->name));
 }
 
 char *dirlist_file_path(struct dirlist_entry *entry)
@@ -128,97 +259,538 @@ static int names_cmp(const void *a, const void *b)
         return cb->is_dir - ca->is_dir;
     }
 
-    int r = strncmp(ca->cache, cb->cache, sizeof(ca->cache));
-    if (r != 0) {
-        return r;
+    // Ties are resolved afterwards by sort_step()
+    return strncmp(ca->cache, cb->cache, sizeof(ca->cache));
+}
+
+static int window_cmp(const void *a, const void *b)
+{
+    const struct window_entry *wa = a;
+    const struct window_entry *wb = b;
+    return strncmp(wa->window, wb->window, SORT_WINDOW);
+}
+
+static bool same_prefix(const cached_entry_t *a, const cached_entry_t *b)
+{
+    return a->is_dir == b->is_dir && strncmp(a->cache, b->cache, sizeof(a->cache)) == 0
+        && memchr(a->cache, 0, sizeof(a->cache)) == NULL;
+}
+
+static int sort_run(cached_entry_t *entries, uint16_t count, uint16_t offset)
+{
+    int r = 0;
+
+    struct window_entry *run = malloc(count * sizeof(*run));
+    if (run == NULL) {
+        return -ENOMEM;
+    }
+    for (uint16_t i = 0; i < count; i++) {
+        run[i].addr = entries[i].addr;
+        if ((r = qspi_read(CMD_READ_MEM, entries[i].addr + offset, (uint8_t *)run[i].window, SORT_WINDOW)) != 0) {
+            goto out;
+        }
+    }
+    qsort(run, count, sizeof(*run), window_cmp);
+    for (uint16_t i = 0; i < count; i++) {
+        entries[i].addr = run[i].addr;
     }
 
-    // Fallback to QSPI read
-    char buf_a[256];
-    char buf_b[256];
-    qspi_read(CMD_READ_MEM, ca->addr, (uint8_t *)buf_a, sizeof(buf_a));
-    qspi_read(CMD_READ_MEM, cb->addr, (uint8_t *)buf_b, sizeof(buf_b));
-    return strcmp(buf_a, buf_b);
+    // Names are at most 255 bytes, a tie past the window needs the next one
+    uint16_t start = 0;
+    for (uint16_t i = 1; i <= count; i++) {
+        if (i < count && window_cmp(&run[start], &run[i]) == 0 && memchr(run[start].window, 0, SORT_WINDOW) == NULL) {
+            continue;
+        }
+        if (i - start > 1 && offset + SORT_WINDOW < FF_MAX_LFN) {
+            if ((r = sort_run(&entries[start], i - start, offset + SORT_WINDOW)) != 0) {
+                goto out;
+            }
+        }
+        start = i;
+    }
+out:
+    free(run);
+    return r;
 }
 
-static int readdir()
+// Begin listing curr_path, the entries show up through dirlist_poll()
+static int start_load()
 {
-    DIR dir;
     FILINFO fno;
-    int r = 0;
-    uint32_t sdram_addr = 0;
 
-    if (f_opendir(&dir, curr_path) != FR_OK) {
-        return false;
+    abort_load();
+
+    memset(&load.index, 0, sizeof(load.index));
+    load.index.magic = INDEX_MAGIC;
+    load.index.hash = 2166136261U; // FNV-1a
+    if (curr_path[0] != '\0' && f_stat(curr_path, &fno) == FR_OK) {
+        load.index.fdate = fno.fdate;
+        load.index.ftime = fno.ftime;
+    }
+
+    // The index is read back only if the directory still carries its stamp,
+    // the hash of the names settles it once they are all listed
+    load.index_fresh = index_fresh(&load.index);
+
+    if (f_opendir(&load.dir, curr_path) != FR_OK) {
+        return -EIO;
     }
+    load.sdram_addr = DIRLIST_ADDR;
+    load.buf_len = 0;
+    load.stage = LOAD_BUILD;
+    return 0;
+}
+
+static void abort_load()
+{
+    if (load.stage == LOAD_BUILD) {
+        f_closedir(&load.dir);
+    }
+    if (load.stage == LOAD_SAVE) {
+        drop_save();
+    }
+    free_merge();
+    if (load.entries.items) {
+        free(load.entries.items);
+    }
+    memset(&load.entries, 0, sizeof(load.entries));
+    load.stage = LOAD_IDLE;
+    load.settled = 0;
+    load.rows = 0;
 
     // Reset lists
     items.count = 0;
     dir_count = 0;
+}
 
-    struct {
-        cached_entry_t *items;
-        uint16_t capacity;
-        uint16_t count;
-    } cache_entries = { 0 };
-
+// The directory is read once. Its names go to SDRAM and into the hash, so
+// an unchanged directory is loaded from its index without a second pass.
+static int build_step()
+{
+    FILINFO fno;
     static uint8_t buf[512];
-    uint16_t buf_len = 0;
+    int r;
 
-    for (;;) {
-        if (f_readdir(&dir, &fno) != FR_OK || fno.fname[0] == 0) {
+    for (uint16_t i = 0;; i++) {
+        if (i == LOAD_STEP) {
+            return 0; // More on the next poll
+        }
+        if (f_readdir(&load.dir, &fno) != FR_OK || fno.fname[0] == 0) {
             break;
         }
-        if (fno.fname[0] == '.' || (fno.fattrib & AM_HID) || (fno.fattrib & AM_SYS)) {
+        if (!is_listed(&fno)) {
             continue; // Skip hidden files
         }
+        for (const char *c = fno.fname; *c; c++) {
+            load.index.hash = (load.index.hash ^ (uint8_t)*c) * 16777619U;
+        }
+        load.index.hash = (load.index.hash ^ (fno.fattrib & AM_DIR)) * 16777619U;
+        load.index.count++;
 
         uint16_t name_len = strlen(fno.fname) + 1;
         uint16_t needed = name_len + (name_len % 2);
 
-        if (buf_len + needed > sizeof(buf)) {
-            if ((r = qspi_write(CMD_WRITE_MEM, sdram_addr, buf, buf_len)) != 0) {
-                goto out;
+        if (load.buf_len + needed > sizeof(buf)) {
+            if ((r = qspi_write(CMD_WRITE_MEM, load.sdram_addr, buf, load.buf_len)) != 0) {
+                return r;
             }
-            sdram_addr += buf_len;
-            buf_len = 0;
+            load.sdram_addr += load.buf_len;
+            load.buf_len = 0;
+        }
+
+        // Leave room for the display row of every entry
+        if (load.sdram_addr + load.buf_len + needed + (load.entries.count + 1) * ROW_SIZE > DIRLIST_ADDR + DIRLIST_SIZE) {
+            return -ENOSPC;
         }
 
         cached_entry_t entry;
-        entry.addr = sdram_addr + buf_len;
+        entry.addr = load.sdram_addr + load.buf_len;
         entry.is_dir = (fno.fattrib & AM_DIR) ? 1 : 0;
         memcpy(entry.cache, fno.fname, sizeof(entry.cache));
 
-        arr_append(cache_entries, entry);
-        if (cache_entries.items == NULL || cache_entries.count == UINT16_MAX) {
-            r = -ENOSPC;
-            goto out;
+        arr_append(load.entries, entry);
+        if (load.entries.items == NULL || load.entries.count == UINT16_MAX) {
+            return -ENOSPC;
         }
 
-        strcpy((char *)&buf[buf_len], fno.fname);
+        strcpy((char *)&buf[load.buf_len], fno.fname);
         if (needed > name_len)
-            buf[buf_len + name_len] = 0;
-        buf_len += needed;
+            buf[load.buf_len + name_len] = 0;
+        load.buf_len += needed;
     }
 
-    if (buf_len > 0) {
-        if ((r = qspi_write(CMD_WRITE_MEM, sdram_addr, buf, buf_len)) != 0) {
-            goto out;
+    if (load.buf_len > 0) {
+        if ((r = qspi_write(CMD_WRITE_MEM, load.sdram_addr, buf, load.buf_len)) != 0) {
+            return r;
         }
+        load.sdram_addr += load.buf_len;
+        load.buf_len = 0;
+    }
+    f_closedir(&load.dir);
+
+    rows_addr = (load.sdram_addr + ROW_SIZE - 1) / ROW_SIZE * ROW_SIZE;
+    load.index.rows_addr = rows_addr;
+
+    // The index holds the same names at the same addresses, only its sorted rows are missing
+    if (load.index_fresh && load_index(&load.index) == 0) {
+        free(load.entries.items);
+        memset(&load.entries, 0, sizeof(load.entries));
+        load.stage = LOAD_IDLE;
+        return 0;
     }
+    load.stage = LOAD_SORT;
 
-    if (cache_entries.count > 0)
-        qsort(cache_entries.items, cache_entries.count, sizeof(cached_entry_t), names_cmp);
+    // Prefixes are in RAM, runs that tie are settled front to back by sort_step()
+    if (load.entries.count > 0) {
+        qsort(load.entries.items, load.entries.count, sizeof(cached_entry_t), names_cmp);
+    }
+    return 0;
+}
+
+// Entries sorted by prefix only are ordered within every run of equal prefixes.
+// Each run is sorted by the next window of the names, fetched once per entry,
+// and runs that still tie go on with the window after that. A single run is
+// sorted per step, so the first page settles long before the last one.
+static int sort_step()
+{
+    cached_entry_t *entries = load.entries.items;
+    uint16_t count = load.entries.count;
+    int r;
+
+    if (load.merge.heads != NULL) {
+        if ((r = merge_step()) != 0) {
+            return r;
+        }
+    } else {
+        while (load.settled < count && load.settled - load.rows < LOAD_STEP) {
+            uint16_t start = load.settled;
+            uint16_t end = start + 1;
+            while (end < count && same_prefix(&entries[start], &entries[end])) {
+                end++;
+            }
+            // Runs too long to sort in one poll settle over the next ones
+            if (end - start > SORT_RUN_MAX) {
+                if ((r = start_merge(start, end - start)) != 0) {
+                    return r;
+                }
+                break;
+            }
+            load.settled = end;
+            // Names sit at even SDRAM addresses, the window starts at an even offset
+            if (end - start > 1) {
+                if ((r = sort_run(&entries[start], end - start, sizeof(entries->cache) - 1)) != 0) {
+                    return r;
+                }
+                break;
+            }
+        }
+    }
 
-    for (uint16_t i = 0; i < cache_entries.count; i++) {
-        arr_append(items, cache_entries.items[i].addr);
-        if (cache_entries.items[i].is_dir) {
+    uint16_t end = load.settled - load.rows > LOAD_STEP ? load.rows + LOAD_STEP : load.settled;
+    if ((r = write_rows(end)) != 0 || load.rows < count) {
+        return r;
+    }
+
+    for (uint16_t i = 0; i < count; i++) {
+        arr_append(items, entries[i].addr);
+        if (entries[i].is_dir) {
             dir_count++;
         }
     }
+    free(load.entries.items);
+    memset(&load.entries, 0, sizeof(load.entries));
+    load.stage = LOAD_IDLE;
+
+    start_save(rows_addr + count * ROW_SIZE - DIRLIST_ADDR);
+    return 0;
+}
+
+// Long runs are sorted a chunk at a time and the chunks merged. Only the head
+// of each chunk keeps its name in RAM, so the merge reads each name once.
+static int start_merge(uint16_t start, uint16_t count)
+{
+    uint16_t chunks = (count + SORT_RUN_MAX - 1) / SORT_RUN_MAX;
+
+    load.merge.heads = malloc(chunks * sizeof(*load.merge.heads));
+    load.merge.merged = malloc(count * sizeof(*load.merge.merged));
+    if (load.merge.heads == NULL || load.merge.merged == NULL) {
+        free_merge();
+        return -ENOMEM;
+    }
+    load.merge.start = start;
+    load.merge.count = count;
+    load.merge.chunks = chunks;
+    load.merge.sorted = 0;
+    load.merge.out = 0;
+    for (uint16_t c = 0; c < chunks; c++) {
+        struct merge_head *h = &load.merge.heads[c];
+        h->pos = start + c * SORT_RUN_MAX;
+        h->end = count - c * SORT_RUN_MAX < SORT_RUN_MAX ? start + count : h->pos + SORT_RUN_MAX;
+    }
+    return 0;
+}
+
+// One chunk sorted, or MERGE_STEP entries merged, per call
+static int merge_step()
+{
+    cached_entry_t *entries = load.entries.items;
+    uint16_t offset = sizeof(entries->cache) - 1;
+    uint16_t len = sizeof(load.merge.heads->name) - offset;
+    int r;
+
+    if (load.merge.sorted < load.merge.chunks) {
+        struct merge_head *h = &load.merge.heads[load.merge.sorted++];
+        if ((r = sort_run(&entries[h->pos], h->end - h->pos, offset)) != 0) {
+            return r;
+        }
+        return qspi_read(CMD_READ_MEM, entries[h->pos].addr + offset, (uint8_t *)h->name, len);
+    }
+
+    for (uint8_t n = 0; n < MERGE_STEP && load.merge.out < load.merge.count; n++) {
+        // Chunks are few, a linear scan finds the smallest head
+        struct merge_head *best = NULL;
+        for (uint16_t c = 0; c < load.merge.chunks; c++) {
+            struct merge_head *h = &load.merge.heads[c];
+            if (h->pos < h->end && (best == NULL || strncmp(h->name, best->name, len) < 0)) {
+                best = h;
+            }
+        }
+        load.merge.merged[load.merge.out++] = entries[best->pos++].addr;
+        if (best->pos < best->end
+            && (r = qspi_read(CMD_READ_MEM, entries[best->pos].addr + offset, (uint8_t *)best->name, len)) != 0) {
+            return r;
+        }
+    }
+    if (load.merge.out < load.merge.count) {
+        return 0;
+    }
+
+    for (uint16_t i = 0; i < load.merge.count; i++) {
+        entries[load.merge.start + i].addr = load.merge.merged[i];
+    }
+    load.settled = load.merge.start + load.merge.count;
+    free_merge();
+    return 0;
+}
+
+static void free_merge()
+{
+    free(load.merge.heads);
+    free(load.merge.merged);
+    load.merge.heads = NULL;
+    load.merge.merged = NULL;
+}
+
+// Copy the start of each settled name into its display row
+static int write_rows(uint16_t end)
+{
+    static struct dirlist_row rows[ROW_BATCH];
+    int r;
+
+    while (load.rows < end) {
+        uint16_t first = load.rows;
+        uint8_t n = end - first < ROW_BATCH ? end - first : ROW_BATCH;
+
+        for (uint8_t i = 0; i < n; i++) {
+            const cached_entry_t *entry = &load.entries.items[first + i];
+            if ((r = qspi_read(CMD_READ_MEM, entry->addr, (uint8_t *)&rows[i], ROW_SIZE)) != 0) {
+                return r;
+            }
+            // Longer names are cut to the row, bytes of the next name are dropped
+            char *nul = memchr(rows[i].name, 0, sizeof(rows[i].name));
+            if (nul == NULL) {
+                nul = &rows[i].name[sizeof(rows[i].name) - 1];
+            }
+            memset(nul, 0, &rows[i].name[sizeof(rows[i].name)] - nul);
+            rows[i].is_dir = entry->is_dir;
+        }
+        if ((r = qspi_write(CMD_WRITE_MEM, rows_addr + first * ROW_SIZE, (uint8_t *)rows, n * ROW_SIZE)) != 0) {
+            return r;
+        }
+        load.rows += n;
+    }
+    return 0;
+}
+
+static bool is_listed(const FILINFO *fno)
+{
+    return !(fno->fname[0] == '.' || (fno->fattrib & AM_HID) || (fno->fattrib & AM_SYS));
+}
+
+static bool index_reader(uint8_t *data, uint32_t size, void *arg)
+{
+    UINT br;
+    return f_read(arg, data, size, &br) == FR_OK && br == size;
+}
+
+static bool index_writer(const uint8_t *data, uint32_t size, void *arg)
+{
+    UINT bw;
+    return f_write(arg, data, size, &bw) == FR_OK && bw == size;
+}
+
+static bool index_fresh(const struct dir_index *expect)
+{
+    struct dir_index index;
+    FIL fp;
+    UINT br;
+
+    char *path = index_path();
+    if (path == NULL) {
+        return false;
+    }
+    FRESULT res = f_open(&fp, path, FA_READ);
+    free(path);
+    if (res != FR_OK) {
+        return false;
+    }
+    bool ok = f_read(&fp, &index, sizeof(index), &br) == FR_OK && br == sizeof(index) && index.magic == expect->magic
+        && index.fdate == expect->fdate && index.ftime == expect->ftime;
+    f_close(&fp);
+    return ok;
+}
+
+static int load_index(const struct dir_index *expect)
+{
+    struct dir_index index;
+    FIL fp;
+    UINT br;
+    int r = -ENOENT;
+
+    char *path = index_path();
+    if (path == NULL) {
+        return -ENOMEM;
+    }
+    if (f_open(&fp, path, FA_READ) != FR_OK) {
+        free(path);
+        return -ENOENT;
+    }
+    free(path);
+
+    if (f_read(&fp, &index, sizeof(index), &br) != FR_OK || br != sizeof(index)) {
+        goto out;
+    }
+    if (index.magic != expect->magic || index.count != expect->count || index.hash != expect->hash
+        || index.fdate != expect->fdate || index.ftime != expect->ftime || index.dir_count > index.count || index.names_size > DIRLIST_SIZE
+        || index.rows_addr != expect->rows_addr || index.names_size < index.rows_addr - DIRLIST_ADDR) {
+        goto out;
+    }
+
+    items.count = 0;
+    dir_count = 0;
+    if (items.capacity < index.count) {
+        uint32_t *p = realloc(items.items, index.count * sizeof(*items.items));
+        if (p == NULL) {
+            r = -ENOMEM;
+            goto out;
+        }
+        items.items = p;
+        items.capacity = index.count;
+    }
+    if (index.count > 0 && (f_read(&fp, items.items, index.count * sizeof(*items.items), &br) != FR_OK
+            || br != index.count * sizeof(*items.items))) {
+        goto out;
+    }
+
+    // The names were just copied by build_step(), only the rows follow in one stream
+    uint32_t names_end = index.rows_addr - DIRLIST_ADDR;
+    if (f_lseek(&fp, f_tell(&fp) + names_end) != FR_OK) {
+        goto out;
+    }
+    if ((r = fpga_api_stream_mem(index.rows_addr, index.names_size - names_end, f_tell(&fp), index_reader, &fp)) != 0) {
+        goto out;
+    }
+    items.count = index.count;
+    dir_count = index.dir_count;
+    rows_addr = index.rows_addr;
 out:
-    if (cache_entries.items)
-        free(cache_entries.items);
-    f_closedir(&dir);
+    f_close(&fp);
     return r;
 }
+
+// Best effort, a read-only card just keeps rebuilding the listing.
+// The listing is complete already, the index follows a chunk per poll.
+static void start_save(uint32_t names_size)
+{
+    UINT bw;
+
+    load.index.dir_count = dir_count;
+    load.index.rows_addr = rows_addr;
+    load.index.names_size = names_size;
+
+    // The host owns the card while it is exported, a write would corrupt its view
+    if (msc_is_active()) {
+        return;
+    }
+    load.save_path = index_path();
+    if (load.save_path == NULL) {
+        return;
+    }
+    if (f_open(&load.fp, load.save_path, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) {
+        free(load.save_path);
+        load.save_path = NULL;
+        return;
+    }
+    load.save_ofs = 0;
+    load.stage = LOAD_SAVE;
+    if (f_write(&load.fp, &load.index, sizeof(load.index), &bw) != FR_OK || bw != sizeof(load.index)) {
+        drop_save();
+    }
+}
+
+// The address table and then the names and rows, SAVE_CHUNK bytes at a time
+static int save_step()
+{
+    uint32_t table_size = items.count * sizeof(*items.items);
+    uint32_t size = table_size + load.index.names_size;
+    uint32_t n = size - load.save_ofs < SAVE_CHUNK ? size - load.save_ofs : SAVE_CHUNK;
+    UINT bw;
+    bool ok;
+
+    if (msc_is_active()) {
+        drop_save();
+        return 0;
+    }
+    if (load.save_ofs < table_size) {
+        n = table_size - load.save_ofs < n ? table_size - load.save_ofs : n;
+        ok = f_write(&load.fp, (uint8_t *)items.items + load.save_ofs, n, &bw) == FR_OK && bw == n;
+    } else {
+        ok = fpga_api_read_mem(DIRLIST_ADDR + load.save_ofs - table_size, n, index_writer, &load.fp) == 0;
+    }
+    load.save_ofs += n;
+
+    if (!ok) {
+        drop_save();
+    } else if (load.save_ofs == size) {
+        if (f_close(&load.fp) != FR_OK) {
+            f_unlink(load.save_path);
+        }
+        free(load.save_path);
+        load.save_path = NULL;
+        load.stage = LOAD_IDLE;
+    }
+    return 0;
+}
+
+// A partial index is removed, the next visit rebuilds the listing
+static void drop_save()
+{
+    f_close(&load.fp);
+    f_unlink(load.save_path);
+    free(load.save_path);
+    load.save_path = NULL;
+    load.stage = LOAD_IDLE;
+}
+
+static char *index_path()
+{
+    uint16_t curr_path_len = strlen(curr_path);
+    char *path = malloc(curr_path_len + sizeof(INDEX_NAME) + 1);
+    if (path == NULL) {
+        return NULL;
+    }
+    strcpy(path, curr_path);
+    path[curr_path_len] = '/';
+    strcpy(&path[curr_path_len + 1], INDEX_NAME);
+    return path;
+}
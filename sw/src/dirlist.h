@@ -2,14 +2,26 @@
 
 #include <stdint.h>
 
+// SDRAM window of the listing, above any PRG/CHR image and below the save state area
+#define DIRLIST_ADDR 0x600000
+#define DIRLIST_SIZE 0x1D0000
+
 struct dirlist_entry {
     char name[256];
     bool is_dir;
 };
 
+// Name cut to the screen width, laid out as stored in SDRAM
+struct dirlist_row {
+    char name[31];
+    uint8_t is_dir;
+};
+
 int dirlist_load();
 int dirlist_push(const char *subdir);
 int dirlist_pop();
+int dirlist_poll();
 uint16_t dirlist_size();
-uint8_t dirlist_select(uint16_t index, uint8_t limit, struct dirlist_entry *out);
+uint8_t dirlist_select(uint16_t index, uint8_t limit, struct dirlist_row *out);
+int dirlist_get(uint16_t index, struct dirlist_entry *out);
 char *dirlist_file_path(struct dirlist_entry *entry);
@@ -2,22 +2,36 @@
 #include <errno.h>
 #include <gpio.h>
 #include <qspi.h>
+#include <soc.h>
 #include <stddef.h>
 #include <stdlib.h>
 
-#define BUF_SIZE 512
+#define STREAM_BUF_SIZE 4096 // Multiple of the SD sector size
+#define MEM_TIMEOUT_MS 1000
+
+// Shared by memory reads and writes, word aligned for SDIO and QSPI DMA
+static uint8_t stream_buf[2][STREAM_BUF_SIZE] __attribute__((aligned(4)));
+
+static int wait_mem_idle();
 
 int fpga_api_write_mem(uint32_t address, uint32_t size, fpga_api_reader_cb cb, void *arg)
 {
-    static uint8_t buf[2][BUF_SIZE * 2];
+    return fpga_api_stream_mem(address, size, 0, cb, arg);
+}
+
+int fpga_api_stream_mem(uint32_t address, uint32_t size, uint32_t skew, fpga_api_reader_cb cb, void *arg)
+{
+    uint8_t (*buf)[STREAM_BUF_SIZE] = stream_buf;
     uint8_t buf_idx = 0;
     uint32_t remain = size;
     uint32_t offset = address;
+    uint32_t chunk = STREAM_BUF_SIZE - skew % STREAM_BUF_SIZE;
     bool pending_write = false;
     int rc = 0;
 
+    // The reader fills one buffer while QSPI DMA drains the other
     while (remain > 0) {
-        uint32_t chunk = remain > BUF_SIZE ? BUF_SIZE : remain;
+        chunk = remain > chunk ? chunk : remain;
         if (!cb(buf[buf_idx], chunk, arg)) {
             rc = -EIO;
             goto out;
@@ -37,6 +51,7 @@ int fpga_api_write_mem(uint32_t address, uint32_t size, fpga_api_reader_cb cb, v
         buf_idx = !buf_idx;
         offset += chunk;
         remain -= chunk;
+        chunk = STREAM_BUF_SIZE;
     }
 
     if (pending_write) {
@@ -50,13 +65,13 @@ out:
 
 int fpga_api_read_mem(uint32_t address, uint32_t size, fpga_api_writer_cb cb, void *arg)
 {
-    static uint8_t buf[2][BUF_SIZE];
+    uint8_t (*buf)[STREAM_BUF_SIZE] = stream_buf;
     uint32_t remain = size;
     uint32_t offset = address;
     int rc = 0;
     uint8_t buf_idx = 0;
 
-    uint32_t chunk = remain > BUF_SIZE ? BUF_SIZE : remain;
+    uint32_t chunk = remain > STREAM_BUF_SIZE ? STREAM_BUF_SIZE : remain;
     if ((rc = qspi_read_begin(CMD_READ_MEM, offset, buf[buf_idx], chunk)) != 0) {
         goto out;
     }
@@ -74,7 +89,7 @@ int fpga_api_read_mem(uint32_t address, uint32_t size, fpga_api_writer_cb cb, vo
         buf_idx = !buf_idx;
 
         if (remain > 0) {
-            chunk = remain > BUF_SIZE ? BUF_SIZE : remain;
+            chunk = remain > STREAM_BUF_SIZE ? STREAM_BUF_SIZE : remain;
             if ((rc = qspi_read_begin(CMD_READ_MEM, offset, buf[buf_idx], chunk)) != 0) {
                 goto out;
             }
@@ -92,6 +107,39 @@ out:
     return rc;
 }
 
+int fpga_api_fill_mem(uint32_t address, uint32_t size, uint16_t pattern)
+{
+    uint8_t args[6] = {size, size >> 8, size >> 16, size >> 24, pattern, pattern >> 8};
+    int rc;
+
+    if ((rc = qspi_write(CMD_FILL_MEM, address, args, sizeof(args))) != 0) {
+        return rc;
+    }
+    return wait_mem_idle();
+}
+
+int fpga_api_copy_mem(uint32_t dst, uint32_t src, uint32_t size)
+{
+    uint8_t args[8] = {src, src >> 8, src >> 16, src >> 24, size, size >> 8, size >> 16, size >> 24};
+    int rc;
+
+    if ((rc = qspi_write(CMD_COPY_MEM, dst, args, sizeof(args))) != 0) {
+        return rc;
+    }
+    return wait_mem_idle();
+}
+
+int fpga_api_crc_mem(uint32_t address, uint32_t size)
+{
+    uint8_t args[4] = {size, size >> 8, size >> 16, size >> 24};
+    int rc;
+
+    if ((rc = qspi_write(CMD_CRC_MEM, address, args, sizeof(args))) != 0) {
+        return rc;
+    }
+    return wait_mem_idle();
+}
+
 int fpga_api_read_reg(enum fpga_reg_id id, uint32_t *value)
 {
     return qspi_read(CMD_READ_REG, id, (uint8_t *)value, sizeof(uint32_t));
@@ -114,3 +162,62 @@ uint32_t fpga_api_ev_reg(void)
     }
     return cached_events;
 }
+
+static int wait_mem_idle()
+{
+    uint32_t busy;
+    uint32_t start = uptime_ms();
+    int rc;
+
+    // The FPGA runs FILL, COPY and CRC on its own, memory commands must wait for it
+    do {
+        if ((rc = fpga_api_read_reg(FPGA_REG_MEM_BUSY, &busy)) != 0) {
+            return rc;
+        }
+        if (uptime_ms() - start > MEM_TIMEOUT_MS) {
+            return -ETIMEDOUT;
+        }
+    } while (busy & 1U);
+    return 0;
+}
+
+#define PERF_FREEZE (1U << 0)
+#define PERF_CLEAR (1U << 1)
+
+int fpga_api_read_perf(struct fpga_perf *perf)
+{
+    int rc;
+
+    // Counters hold still while frozen so the snapshot is consistent
+    if ((rc = fpga_api_write_reg(FPGA_REG_PERF, PERF_FREEZE)) != 0) {
+        return rc;
+    }
+    for (uint32_t i = 0; i < FPGA_PERF_COUNT; i++) {
+        if ((rc = qspi_read(CMD_READ_REG, FPGA_REG_PERF | (i << 8), (uint8_t *)&perf->counter[i], sizeof(uint32_t))) != 0) {
+            break;
+        }
+    }
+    int unfreeze = fpga_api_write_reg(FPGA_REG_PERF, 0);
+    return rc != 0 ? rc : unfreeze;
+}
+
+int fpga_api_clear_perf(void)
+{
+    return fpga_api_write_reg(FPGA_REG_PERF, PERF_CLEAR);
+}
+
+int fpga_api_wram_dirty(uint32_t dirty[FPGA_WRAM_DIRTY_PAGES / 32])
+{
+    int rc;
+
+    // Writing the register moves the bitmap into the snapshot and starts tracking anew
+    if ((rc = fpga_api_write_reg(FPGA_REG_WRAM_DIRTY, 0)) != 0) {
+        return rc;
+    }
+    for (uint32_t i = 0; i < FPGA_WRAM_DIRTY_PAGES / 32; i++) {
+        if ((rc = qspi_read(CMD_READ_REG, FPGA_REG_WRAM_DIRTY | (i << 8), (uint8_t *)&dirty[i], sizeof(uint32_t))) != 0) {
+            return rc;
+        }
+    }
+    return 0;
+}
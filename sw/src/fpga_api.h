@@ -1,26 +1,77 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 
 enum {
     CMD_READ_MEM = 0,
     CMD_WRITE_MEM,
     CMD_READ_REG,
-    CMD_WRITE_REG
+    CMD_WRITE_REG,
+    CMD_FILL_MEM = 5,
+    CMD_COPY_MEM = 7,
+    CMD_CRC_MEM = 9
 };
 
 enum fpga_reg_id {
     FPGA_REG_MAPPER = 0,
     FPGA_REG_LAUNCHER = 1,
-    FPGA_REG_EVENTS = 1
+    FPGA_REG_EVENTS = 1,
+    FPGA_REG_VERSION = 2,
+    FPGA_REG_PERF = 3,
+    FPGA_REG_CRC = 4, // CRC32 of memory data since the last write to this register
+    FPGA_REG_MEM_BUSY = 5,
+    FPGA_REG_MEM_CRC = 6, // CRC32 of memory contents summed by CMD_CRC_MEM
+    FPGA_REG_WRAM_DIRTY = 7 // WRAM pages written by the CPU
+};
+
+#define FPGA_WRAM_PAGE_SIZE 256
+#define FPGA_WRAM_DIRTY_PAGES 128
+
+enum fpga_perf_counter {
+    FPGA_PERF_CLOCKS = 0,
+    FPGA_PERF_CPU_REQ,
+    FPGA_PERF_CPU_ACK,
+    FPGA_PERF_CPU_WAIT,
+    FPGA_PERF_PPU_REQ,
+    FPGA_PERF_PPU_ACK,
+    FPGA_PERF_PPU_WAIT,
+    FPGA_PERF_API_REQ,
+    FPGA_PERF_API_ACK,
+    FPGA_PERF_API_WAIT,
+    FPGA_PERF_REFRESH,
+    FPGA_PERF_REFRESH_DEFER,
+    FPGA_PERF_QSPI_WORDS,
+    FPGA_PERF_QSPI_RX_EMPTY,
+    FPGA_PERF_QSPI_TX_FULL,
+    FPGA_PERF_PRG_HIT,
+    FPGA_PERF_PRG_MISS,
+    FPGA_PERF_COUNT
+};
+
+// Counters are 24 bits wide and wrap, the clock count after 168 ms
+struct fpga_perf {
+    uint32_t counter[FPGA_PERF_COUNT];
 };
 
 typedef bool (*fpga_api_reader_cb)(uint8_t *, uint32_t, void *);
 typedef bool (*fpga_api_writer_cb)(const uint8_t *, uint32_t, void *);
 
 int fpga_api_write_mem(uint32_t address, uint32_t size, fpga_api_reader_cb cb, void *arg);
+// The first chunk is cut short by skew, so that the rest start on a sector boundary
+// of the source file and FatFs can read whole sectors straight into the buffers
+int fpga_api_stream_mem(uint32_t address, uint32_t size, uint32_t skew, fpga_api_reader_cb cb, void *arg);
 int fpga_api_read_mem(uint32_t address, uint32_t size, fpga_api_writer_cb cb, void *arg);
+// The pattern repeats every word, its low byte lands at even addresses
+int fpga_api_fill_mem(uint32_t address, uint32_t size, uint16_t pattern);
+int fpga_api_copy_mem(uint32_t dst, uint32_t src, uint32_t size);
+int fpga_api_crc_mem(uint32_t address, uint32_t size);
 
 int fpga_api_read_reg(enum fpga_reg_id id, uint32_t *value);
 int fpga_api_write_reg(enum fpga_reg_id id, uint32_t value);
 uint32_t fpga_api_ev_reg();
+
+int fpga_api_read_perf(struct fpga_perf *perf);
+int fpga_api_clear_perf();
+
+int fpga_api_wram_dirty(uint32_t dirty[FPGA_WRAM_DIRTY_PAGES / 32]);
@@ -1,6 +1,8 @@
 #include "gfx.h"
 #include "font8x8.h"
 #include "fpga_api.h"
+#include <qspi.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -10,29 +12,65 @@
 #define FB_SIZE (SCREEN_WIDTH * SCREEN_HEIGHT / 8U * BPP)
 #define FRAME_SIZE (1U << 14) // 16KB
 #define FB_ADDR 0x7D8000
+#define TILE_SIZE 16 // 8x8 pixels in two bitplanes
+#define TILES (FB_SIZE / TILE_SIZE)
+#define FONT_ADDR 0x7D4000
+#define FONT_SIZE (256 * TILE_SIZE)
+#define NT_OFFSET FB_SIZE // Last 1KB of each frame, unused by the bitmap
+#define NT_COLS (SCREEN_WIDTH / 8)
+#define NT_ROWS (SCREEN_HEIGHT / 8)
+#define NT_TILES (NT_COLS * NT_ROWS)
+#define TILE_HIGHLIGHT 0x80 // Glyph on a color 2 background
+#define RING_FIRST 2 // Rows the launcher keeps as a ring, see gfx_text_scroll()
+#define RING_ROWS 26
 
 static uint8_t framebuffer[FB_SIZE];
+static uint8_t shown[FB_SIZE]; // Last uploaded frame
 static uint8_t curr_buffer;
-static bool fb_reader(uint8_t *data, uint32_t size, void *arg);
+// Tiles where each SDRAM buffer matches the last uploaded frame
+static uint32_t fresh[2][TILES / 32];
 
-void gfx_pixel(uint16_t x, uint16_t y, uint8_t color)
+// Text mode nametable followed by one palette byte per row, as laid out in SDRAM
+static uint8_t nametable[NT_TILES + 32];
+static uint8_t nt_stored[2][sizeof(nametable)]; // Rows as laid out in each SDRAM buffer
+static bool nt_valid[2];
+static uint8_t ring_offset;
+static bool font_loaded;
+static bool font_reader(uint8_t *data, uint32_t size, void *arg);
+
+// Set the masked pixels of one tile row in both bitplanes
+static inline void blit(uint16_t tx, uint16_t y, uint8_t mask, uint8_t color)
 {
-    if (x >= SCREEN_WIDTH || y >= SCREEN_HEIGHT) {
+    if (mask == 0 || tx >= SCREEN_WIDTH / 8 || y >= SCREEN_HEIGHT) {
         return;
     }
-    uint32_t tile_idx = (y / 8 * 32) + (x / 8);
-    uint32_t fb_idx = (tile_idx * 16) + (y % 8); // Each tile is 16 bytes
-    uint8_t bitmask = 128U >> (x % 8);
-    framebuffer[fb_idx] &= ~bitmask; // Clear the bits for this pixel
-    if (color & 0x01) {
-        framebuffer[fb_idx] |= bitmask;
+    uint8_t *p = &framebuffer[(y / 8 * 32 + tx) * TILE_SIZE + y % 8];
+    p[0] = (color & 0x01) ? p[0] | mask : p[0] & ~mask;
+    p[8] = (color & 0x02) ? p[8] | mask : p[8] & ~mask; // Second byte for 2bpp
+}
+
+// Font rows keep the leftmost pixel in bit 0, tiles in bit 7
+static inline uint8_t reverse_bits(uint8_t b)
+{
+    b = (b & 0xF0) >> 4 | (b & 0x0F) << 4;
+    b = (b & 0xCC) >> 2 | (b & 0x33) << 2;
+    return (b & 0xAA) >> 1 | (b & 0x55) << 1;
+}
+
+static inline uint8_t glyph_index(char c)
+{
+    if (c < 32 || c > 127) {
+        c = '?'; // Replace unsupported characters
     }
+    return c - 32;
+}
 
-    fb_idx += 8; // Move to the second byte for 2bpp
-    framebuffer[fb_idx] &= ~bitmask;
-    if (color & 0x02) {
-        framebuffer[fb_idx] |= bitmask;
+void gfx_pixel(uint16_t x, uint16_t y, uint8_t color)
+{
+    if (x >= SCREEN_WIDTH || y >= SCREEN_HEIGHT) {
+        return;
     }
+    blit(x / 8, y, 128U >> (x % 8), color);
 }
 
 void gfx_text(uint16_t x, uint16_t y, const char *str, int len, uint8_t color)
@@ -42,18 +80,18 @@ void gfx_text(uint16_t x, uint16_t y, const char *str, int len, uint8_t color)
         if (len > 0 && i++ >= len) {
             break;
         }
-
-        char c = *str++;
-        if (c < 32 || c > 127) {
-            c = '?'; // Replace unsupported characters
+        if (x >= SCREEN_WIDTH) {
+            break;
         }
 
-        const uint8_t *char_bitmap = font8x8[c - 32];
+        // Whole glyph rows, split over two tiles when x is not tile aligned
+        const uint8_t *char_bitmap = font8x8[glyph_index(*str++)];
+        uint8_t shift = x % 8;
         for (int row = 0; row < 8; row++) {
-            for (int col = 0; col < 8; col++) {
-                if (char_bitmap[row] & 1 << col) {
-                    gfx_pixel(x + col, y + row, color);
-                }
+            uint8_t bits = reverse_bits(char_bitmap[row]);
+            blit(x / 8, y + row, bits >> shift, color);
+            if (shift) {
+                blit(x / 8 + 1, y + row, (uint8_t)(bits << (8 - shift)), color);
             }
         }
         x += 8; // Move to the next character position
@@ -86,9 +124,42 @@ void gfx_line(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint8_t color)
 
 void gfx_fill_rect(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t color)
 {
-    for (uint16_t i = 0; i < h; i++) {
-        for (uint16_t j = 0; j < w; j++) {
-            gfx_pixel(x + j, y + i, color);
+    if (x >= SCREEN_WIDTH || y >= SCREEN_HEIGHT || w == 0 || h == 0) {
+        return;
+    }
+    if (w > SCREEN_WIDTH - x) {
+        w = SCREEN_WIDTH - x;
+    }
+    if (h > SCREEN_HEIGHT - y) {
+        h = SCREEN_HEIGHT - y;
+    }
+
+    uint16_t last = x + w - 1;
+    for (uint16_t tx = x / 8; tx <= last / 8; tx++) {
+        uint8_t mask = 0xFF;
+        if (tx == x / 8) {
+            mask &= 0xFF >> (x % 8);
+        }
+        if (tx == last / 8) {
+            mask &= (uint8_t)(0xFF << (7 - last % 8));
+        }
+
+        // Rows of a tile are consecutive bytes within each bitplane
+        for (uint16_t row = y; row < y + h;) {
+            uint16_t n = 8 - row % 8;
+            if (n > y + h - row) {
+                n = y + h - row;
+            }
+            if (mask == 0xFF) {
+                uint8_t *p = &framebuffer[(row / 8 * 32 + tx) * TILE_SIZE + row % 8];
+                memset(p, (color & 0x01) ? 0xFF : 0, n);
+                memset(p + 8, (color & 0x02) ? 0xFF : 0, n);
+            } else {
+                for (uint16_t i = 0; i < n; i++) {
+                    blit(tx, row + i, mask, color);
+                }
+            }
+            row += n;
         }
     }
 }
@@ -100,26 +171,145 @@ void gfx_clear()
 
 void gfx_refresh()
 {
-    uint32_t offset = 0;
-    uint32_t addr = FB_ADDR;
+    uint8_t back = !curr_buffer;
+    uint32_t addr = back ? FB_ADDR + FRAME_SIZE : FB_ADDR;
 
-    curr_buffer = !curr_buffer;
-    if (curr_buffer) {
-        addr += FRAME_SIZE;
+    // Both buffers miss the tiles changed since the last frame
+    for (uint16_t i = 0; i < TILES; i++) {
+        uint8_t *tile = &framebuffer[i * TILE_SIZE];
+        if (memcmp(tile, &shown[i * TILE_SIZE], TILE_SIZE) != 0) {
+            memcpy(&shown[i * TILE_SIZE], tile, TILE_SIZE);
+            fresh[0][i / 32] &= ~(1U << (i % 32));
+            fresh[1][i / 32] &= ~(1U << (i % 32));
+        }
     }
-    fpga_api_write_mem(addr, FB_SIZE, fb_reader, &offset);
 
+    // Upload each run of stale tiles into the back buffer
+    for (uint16_t i = 0; i < TILES;) {
+        if (fresh[back][i / 32] & 1U << (i % 32)) {
+            i++;
+            continue;
+        }
+        uint16_t start = i;
+        while (i < TILES && !(fresh[back][i / 32] & 1U << (i % 32))) {
+            i++;
+        }
+        if (qspi_write(CMD_WRITE_MEM, addr + start * TILE_SIZE, &framebuffer[start * TILE_SIZE], (i - start) * TILE_SIZE)
+            != 0) {
+            return; // Keep the old frame, the tiles stay stale
+        }
+    }
+    memset(fresh[back], 0xFF, sizeof(fresh[back]));
+
+    curr_buffer = back;
     uint32_t args = curr_buffer;
     fpga_api_write_reg(FPGA_REG_LAUNCHER, args);
 }
 
-static bool fb_reader(uint8_t *data, uint32_t size, void *arg)
+void gfx_text_clear()
+{
+    memset(nametable, 0, sizeof(nametable));
+}
+
+void gfx_text_put(uint8_t col, uint8_t row, const char *str, int len, uint8_t color)
+{
+    if (row >= NT_ROWS) {
+        return;
+    }
+    uint8_t *tiles = &nametable[row * NT_COLS];
+    for (int i = 0; *str && col < NT_COLS && (len <= 0 || i < len); i++, col++) {
+        tiles[col] = (tiles[col] & TILE_HIGHLIGHT) | glyph_index(*str++);
+    }
+    if (color & 0x02) {
+        nametable[NT_TILES + row] |= 0x55; // Palette 1 in every attribute quadrant
+    }
+}
+
+// The list rows shift up by rows on the next refresh. The launcher remaps them,
+// so only rows with new content are uploaded.
+void gfx_text_scroll(int rows)
+{
+    int offset = (ring_offset + rows) % RING_ROWS;
+    ring_offset = offset < 0 ? offset + RING_ROWS : offset;
+}
+
+void gfx_text_bar(uint8_t col, uint8_t row, uint8_t cols)
+{
+    if (row >= NT_ROWS) {
+        return;
+    }
+    for (; cols > 0 && col < NT_COLS; cols--, col++) {
+        nametable[row * NT_COLS + col] |= TILE_HIGHLIGHT;
+    }
+    nametable[NT_TILES + row] |= 0xAA; // Palette 2 in every attribute quadrant
+}
+
+static uint8_t ring_row(uint8_t row)
+{
+    if (row < RING_FIRST || row >= RING_FIRST + RING_ROWS) {
+        return row;
+    }
+    return RING_FIRST + (row - RING_FIRST + ring_offset) % RING_ROWS;
+}
+
+// The font goes to SDRAM once, each frame is then just the nametable
+void gfx_text_refresh()
+{
+    if (!font_loaded) {
+        uint32_t offset = 0;
+        if (fpga_api_write_mem(FONT_ADDR, FONT_SIZE, font_reader, &offset) != 0) {
+            return;
+        }
+        font_loaded = true;
+    }
+
+    uint8_t back = !curr_buffer;
+    uint32_t addr = (back ? FB_ADDR + FRAME_SIZE : FB_ADDR) + NT_OFFSET;
+    uint8_t *stored = nt_stored[back];
+    bool palettes = !nt_valid[back];
+
+    // Rows already in the back buffer stay, even if the ring moved them
+    for (uint8_t row = 0; row < NT_ROWS; row++) {
+        uint8_t phys = ring_row(row);
+        uint8_t *tiles = &nametable[row * NT_COLS];
+        if (!nt_valid[back] || memcmp(tiles, &stored[phys * NT_COLS], NT_COLS) != 0) {
+            memcpy(&stored[phys * NT_COLS], tiles, NT_COLS);
+            if (qspi_write(CMD_WRITE_MEM, addr + phys * NT_COLS, tiles, NT_COLS) != 0) {
+                nt_valid[back] = false;
+                return;
+            }
+        }
+        if (stored[NT_TILES + phys] != nametable[NT_TILES + row]) {
+            stored[NT_TILES + phys] = nametable[NT_TILES + row];
+            palettes = true;
+        }
+    }
+    if (palettes && qspi_write(CMD_WRITE_MEM, addr + NT_TILES, &stored[NT_TILES], sizeof(nametable) - NT_TILES) != 0) {
+        nt_valid[back] = false;
+        return;
+    }
+    nt_valid[back] = true;
+
+    curr_buffer = back;
+    uint32_t args = curr_buffer | (1U << 5) | (ring_offset << 6); // text mode, list ring offset
+    fpga_api_write_reg(FPGA_REG_LAUNCHER, args);
+}
+
+// Glyphs in color 1, highlighted copies above TILE_HIGHLIGHT also set every color 2 bit
+static bool font_reader(uint8_t *data, uint32_t size, void *arg)
 {
     uint32_t *off = arg;
-    if (*off + size > FB_SIZE) {
-        return false;
+    for (uint32_t i = 0; i < size; i++, (*off)++) {
+        uint8_t tile = *off / TILE_SIZE;
+        uint8_t line = *off % TILE_SIZE;
+        uint8_t glyph = tile & ~TILE_HIGHLIGHT;
+        if (glyph >= sizeof(font8x8) / sizeof(font8x8[0])) {
+            data[i] = 0;
+        } else if (line < 8) {
+            data[i] = reverse_bits(font8x8[glyph][line]);
+        } else {
+            data[i] = (tile & TILE_HIGHLIGHT) ? 0xFF : 0;
+        }
     }
-    memcpy(data, framebuffer + *off, size);
-    *off += size;
     return true;
 }
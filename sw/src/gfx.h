@@ -8,3 +8,10 @@ void gfx_line(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint8_t color)
 void gfx_fill_rect(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t color);
 void gfx_clear();
 void gfx_refresh();
+
+// Text mode, a 32x30 grid of font tiles with one color per row
+void gfx_text_clear();
+void gfx_text_put(uint8_t col, uint8_t row, const char *str, int len, uint8_t color);
+void gfx_text_bar(uint8_t col, uint8_t row, uint8_t cols);
+void gfx_text_scroll(int rows);
+void gfx_text_refresh();
@@ -1,7 +1,21 @@
+#include "msc.h"
 #include "diskio.h"
 #include "ui.h"
 #include <tusb.h>
 
+static bool ejected; // The host let go of the card, the firmware may write it again
+
+bool msc_is_active()
+{
+    return tud_mounted() && !ejected;
+}
+
+// Invoked when the device is configured by the host
+void tud_mount_cb(void)
+{
+    ejected = false;
+}
+
 // Invoked when received SCSI_CMD_INQUIRY, v2 with full inquiry response
 // Some inquiry_resp's fields are already filled with default values, application can update them
 // Return length of inquiry response, typically sizeof(scsi_inquiry_resp_t) (36 bytes), can be longer if included vendor data.
@@ -68,6 +82,7 @@ bool tud_msc_start_stop_cb(uint8_t lun, uint8_t power_condition, bool start, boo
                 return false;
             }
         }
+        ejected = !start;
     }
     return true;
 }
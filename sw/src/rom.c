@@ -1,4 +1,7 @@
 #include "rom.h"
+#include "crc32.h"
+#include "diskio.h"
+#include "dirlist.h"
 #include "err.h"
 #include "fpga_api.h"
 #include <errno.h>
@@ -15,23 +18,81 @@
 #define WRAM_ADDR 0x7E0000
 #define SST_ADDR 0x7D0000
 #define SST_SIZE 0x1400 // 5KB
+_Static_assert(DIRLIST_ADDR + DIRLIST_SIZE <= SST_ADDR, "Listing window overlaps the save states");
 #define SAVE_DIR "/saves"
 
+#define CLMT_SIZE 64 // Cluster link map for up to 31 fragments
+
 #define max(a, b) ((a) > (b) ? (a) : (b))
 
+enum clmt_slot {
+    CLMT_ROM,
+    CLMT_SAV,
+    CLMT_ST,
+    CLMT_SLOTS
+};
+
+// Cluster link map of a file, valid while the file stays the same
+struct clmt_entry {
+    bool valid;
+    char path[256];
+    FSIZE_t fsize;
+    WORD fdate;
+    WORD ftime;
+    DWORD tbl[CLMT_SIZE];
+};
+
+// Output of a save file, sector is set when it is written past FatFs
+struct save_writer {
+    FIL *fp;
+    LBA_t sector;
+};
+
+struct crc_reader {
+    FIL *fp;
+    uint32_t crc;
+    const uint8_t *pending; // Previous chunk, summed while the SD card reads the next one
+    uint32_t pending_size;
+};
+
+// ROM image left in SDRAM by the previous load
+struct resident_rom {
+    bool valid;
+    char path[256];
+    FSIZE_t fsize;
+    WORD fdate;
+    WORD ftime;
+    uint32_t prg_size;
+    uint32_t chr_size;
+    uint32_t chr_addr;
+    uint32_t crc;
+};
+
 static char *save_name;
 static uint32_t wram_size;
 static uint32_t curr_mapper_args;
 static uint32_t chr_ram_size;
 static uint32_t chr_ram_addr;
+static struct resident_rom resident;
+static bool save_full = true; // The .sav file may differ from WRAM outside the dirty pages
+static struct clmt_entry clmt_cache[CLMT_SLOTS];
 
 static bool file_reader(uint8_t *data, uint32_t size, void *arg);
+static bool crc_file_reader(uint8_t *data, uint32_t size, void *arg);
+static void crc_reader_flush(struct crc_reader *reader);
+static LBA_t file_sector(FIL *fp, FSIZE_t ofs, uint32_t *run);
 static bool file_writer(const uint8_t *data, uint32_t size, void *arg);
-static bool const_reader(uint8_t *data, uint32_t size, void *arg);
 static uint32_t exp_size(uint32_t size);
 static uint32_t shift_size(uint8_t shift);
 static bool choose_mapper(uint16_t id, uint8_t sub, uint8_t *int_id, uint8_t *int_sub, bool *bus_conflict);
 static uint8_t get_chr_off(uint32_t prg_size);
+static int save_dirty_pages(FIL *fp, const uint32_t *dirty);
+static FRESULT open_mapped(FIL *fp, const char *path, BYTE mode, enum clmt_slot slot, FILINFO *fno);
+static void clmt_update(enum clmt_slot slot);
+static FRESULT open_save(FIL *fp, const char *path, FSIZE_t size, bool raw, enum clmt_slot slot, LBA_t *sector);
+static bool save_writer(const uint8_t *data, uint32_t size, void *arg);
+static bool is_resident(const char *filename, const FILINFO *fno, uint32_t prg_size, uint32_t chr_size);
+static int load_image(FIL *fp, uint32_t prg_size, uint32_t chr_size);
 
 static void set_save_name(const char *rom_path)
 {
@@ -65,6 +126,7 @@ int rom_save_battery()
 {
     FRESULT rc;
     int err = 0;
+    uint32_t dirty[FPGA_WRAM_DIRTY_PAGES / 32];
 
     if (!save_name || wram_size == 0) {
         return 0;
@@ -72,14 +134,42 @@ int rom_save_battery()
     char path[256];
     get_save_path(path, sizeof(path), ".sav");
 
-    f_mkdir(SAVE_DIR);
+    // Take the snapshot even for a full save so that tracking restarts from here
+    if ((err = fpga_api_wram_dirty(dirty)) != 0) {
+        return err;
+    }
 
     FIL fp;
-    if ((rc = f_open(&fp, path, FA_WRITE | FA_CREATE_ALWAYS)) != FR_OK) {
+    if (!save_full && wram_size <= FPGA_WRAM_DIRTY_PAGES * FPGA_WRAM_PAGE_SIZE) {
+        bool clean = true;
+        for (uint32_t i = 0; i < FPGA_WRAM_DIRTY_PAGES / 32; i++) {
+            clean = clean && dirty[i] == 0;
+        }
+        if (clean) {
+            return 0;
+        }
+        FILINFO fno;
+        if (open_mapped(&fp, path, FA_WRITE | FA_OPEN_EXISTING, CLMT_SAV, &fno) == FR_OK) {
+            if (f_size(&fp) == wram_size) {
+                err = save_dirty_pages(&fp, dirty);
+                f_close(&fp);
+                clmt_update(CLMT_SAV);
+                save_full = err != 0;
+                return err;
+            }
+            f_close(&fp);
+        }
+    }
+
+    f_mkdir(SAVE_DIR);
+
+    struct save_writer writer = {.fp = &fp};
+    if ((rc = open_save(&fp, path, wram_size, wram_size % FF_MIN_SS == 0, CLMT_SAV, &writer.sector)) != FR_OK) {
         return -fresult_to_errno(rc);
     }
-    err = fpga_api_read_mem(WRAM_ADDR, wram_size, file_writer, &fp);
+    err = fpga_api_read_mem(WRAM_ADDR, wram_size, save_writer, &writer);
     f_close(&fp);
+    save_full = err != 0;
     return err;
 }
 
@@ -98,15 +188,18 @@ int rom_save_state()
     f_mkdir(SAVE_DIR);
 
     FIL fp;
-    if ((rc = f_open(&fp, path, FA_WRITE | FA_CREATE_ALWAYS)) != FR_OK) {
+    struct save_writer writer = {.fp = &fp};
+    uint32_t size = SST_SIZE + chr_ram_size + wram_size;
+    bool raw = (SST_SIZE | chr_ram_size | wram_size) % FF_MIN_SS == 0;
+    if ((rc = open_save(&fp, path, size, raw, CLMT_ST, &writer.sector)) != FR_OK) {
         return -fresult_to_errno(rc);
     }
-    err = fpga_api_read_mem(SST_ADDR, SST_SIZE, file_writer, &fp);
+    err = fpga_api_read_mem(SST_ADDR, SST_SIZE, save_writer, &writer);
     if (err == 0 && chr_ram_size > 0) {
-        err = fpga_api_read_mem(chr_ram_addr, chr_ram_size, file_writer, &fp);
+        err = fpga_api_read_mem(chr_ram_addr, chr_ram_size, save_writer, &writer);
     }
     if (err == 0 && wram_size > 0) {
-        err = fpga_api_read_mem(WRAM_ADDR, wram_size, file_writer, &fp);
+        err = fpga_api_read_mem(WRAM_ADDR, wram_size, save_writer, &writer);
     }
     f_close(&fp);
     return err;
@@ -125,7 +218,8 @@ int rom_restore_state()
     get_save_path(path, sizeof(path), ".st");
 
     FIL fp;
-    if ((rc = f_open(&fp, path, FA_READ)) != FR_OK) {
+    FILINFO fno;
+    if ((rc = open_mapped(&fp, path, FA_READ, CLMT_ST, &fno)) != FR_OK) {
         return -fresult_to_errno(rc);
     }
     err = fpga_api_write_mem(SST_ADDR, SST_SIZE, file_reader, &fp);
@@ -133,6 +227,8 @@ int rom_restore_state()
         err = fpga_api_write_mem(chr_ram_addr, chr_ram_size, file_reader, &fp);
     }
     if (err == 0 && wram_size > 0) {
+        // WRAM no longer matches the .sav file
+        save_full = true;
         err = fpga_api_write_mem(WRAM_ADDR, wram_size, file_reader, &fp);
     }
     f_close(&fp);
@@ -147,9 +243,9 @@ int rom_load(const char *filename)
     int err = 0;
 
     uint8_t header[16];
-    if ((rc = f_open(&fp, filename, FA_READ)) != FR_OK) {
-        err = -fresult_to_errno(rc);
-        goto out;
+    FILINFO fno;
+    if ((rc = open_mapped(&fp, filename, FA_READ, CLMT_ROM, &fno)) != FR_OK) {
+        return -fresult_to_errno(rc);
     }
     if ((rc = f_read(&fp, header, sizeof(header), &sz) != FR_OK)) {
         err = -fresult_to_errno(rc);
@@ -228,20 +324,41 @@ int rom_load(const char *filename)
         }
     }
 
-    fpga_api_write_mem(0, prg_size, file_reader, &fp);
-    fpga_api_write_mem(chr_ram_addr, chr_size, file_reader, &fp);
+    // Reloading the same ROM only needs the SDRAM contents to be verified
+    if (!is_resident(filename, &fno, prg_size, chr_size)) {
+        resident.valid = false;
+        if ((err = load_image(&fp, prg_size, chr_size)) != 0) {
+            goto out;
+        }
+        strncpy(resident.path, filename, sizeof(resident.path) - 1);
+        resident.path[sizeof(resident.path) - 1] = 0;
+        resident.fsize = fno.fsize;
+        resident.fdate = fno.fdate;
+        resident.ftime = fno.ftime;
+        resident.prg_size = prg_size;
+        resident.chr_size = chr_size;
+        resident.chr_addr = chr_ram_addr;
+        // The menu listing would overwrite an image reaching into its window
+        resident.valid = chr_ram_addr + chr_size <= DIRLIST_ADDR && prg_size <= DIRLIST_ADDR;
+    }
 
     set_save_name(filename);
+    save_full = true;
     if (has_battery) {
         char path[256];
         get_save_path(path, sizeof(path), ".sav");
 
         FIL sfp;
-        if (f_open(&sfp, path, FA_READ) == FR_OK) {
-            fpga_api_write_mem(WRAM_ADDR, wram_size, file_reader, &sfp);
+        FILINFO sfno;
+        if (open_mapped(&sfp, path, FA_READ, CLMT_SAV, &sfno) == FR_OK) {
+            // WRAM matches the file, only pages the game writes from now on need saving
+            uint32_t dirty[FPGA_WRAM_DIRTY_PAGES / 32];
+            if (fpga_api_write_mem(WRAM_ADDR, wram_size, file_reader, &sfp) == 0 && f_size(&sfp) == wram_size) {
+                save_full = fpga_api_wram_dirty(dirty) != 0;
+            }
             f_close(&sfp);
         } else {
-            fpga_api_write_mem(WRAM_ADDR, wram_size, const_reader, (void *)0x00);
+            fpga_api_fill_mem(WRAM_ADDR, wram_size, 0x0000);
         }
     } else {
         wram_size = 0;
@@ -282,6 +399,190 @@ out:
     return err;
 }
 
+static int load_image(FIL *fp, uint32_t prg_size, uint32_t chr_size)
+{
+    // The FPGA computes the CRC of the data it receives, compare with what was read from the file
+    struct crc_reader reader = {.fp = fp, .crc = 0};
+    uint32_t fpga_crc;
+    int err;
+
+    if ((err = fpga_api_write_reg(FPGA_REG_CRC, 0)) != 0) {
+        return err;
+    }
+    if ((err = fpga_api_stream_mem(0, prg_size, f_tell(fp), crc_file_reader, &reader)) != 0) {
+        return err;
+    }
+    crc_reader_flush(&reader);
+    if ((err = fpga_api_stream_mem(chr_ram_addr, chr_size, f_tell(fp), crc_file_reader, &reader)) != 0) {
+        return err;
+    }
+    crc_reader_flush(&reader);
+    if ((err = fpga_api_read_reg(FPGA_REG_CRC, &fpga_crc)) != 0) {
+        return err;
+    }
+    if (fpga_crc != reader.crc) {
+        return -EIO;
+    }
+    resident.crc = reader.crc;
+    return 0;
+}
+
+// The file must be unchanged and the FPGA must read back the same CRC from SDRAM
+static bool is_resident(const char *filename, const FILINFO *fno, uint32_t prg_size, uint32_t chr_size)
+{
+    uint32_t crc;
+
+    if (!resident.valid || strcmp(resident.path, filename) != 0) {
+        return false;
+    }
+    if (resident.fsize != fno->fsize || resident.fdate != fno->fdate || resident.ftime != fno->ftime) {
+        return false;
+    }
+    if (resident.prg_size != prg_size || resident.chr_size != chr_size || resident.chr_addr != chr_ram_addr) {
+        return false;
+    }
+    if (fpga_api_write_reg(FPGA_REG_MEM_CRC, 0) != 0) {
+        return false;
+    }
+    if (fpga_api_crc_mem(0, prg_size) != 0 || fpga_api_crc_mem(chr_ram_addr, chr_size) != 0) {
+        return false;
+    }
+    if (fpga_api_read_reg(FPGA_REG_MEM_CRC, &crc) != 0) {
+        return false;
+    }
+    return crc == resident.crc;
+}
+
+// Rewrite runs of consecutive dirty pages in place
+static int save_dirty_pages(FIL *fp, const uint32_t *dirty)
+{
+    uint32_t pages = (wram_size + FPGA_WRAM_PAGE_SIZE - 1) / FPGA_WRAM_PAGE_SIZE;
+    FRESULT rc;
+    int err;
+
+    for (uint32_t first = 0; first < pages; first++) {
+        if (!(dirty[first / 32] & (1U << (first % 32)))) {
+            continue;
+        }
+        uint32_t last = first;
+        while (last + 1 < pages && (dirty[(last + 1) / 32] & (1U << ((last + 1) % 32)))) {
+            last++;
+        }
+
+        uint32_t offset = first * FPGA_WRAM_PAGE_SIZE;
+        uint32_t size = (last + 1) * FPGA_WRAM_PAGE_SIZE;
+        size = (size > wram_size ? wram_size : size) - offset;
+        if ((rc = f_lseek(fp, offset)) != FR_OK) {
+            return -fresult_to_errno(rc);
+        }
+        if ((err = fpga_api_read_mem(WRAM_ADDR + offset, size, file_writer, fp)) != 0) {
+            return err;
+        }
+        first = last;
+    }
+    return 0;
+}
+
+// Open a file with its cluster link map attached, so that reads and seeks take
+// cluster numbers from the map instead of following the FAT chain on the card
+static FRESULT open_mapped(FIL *fp, const char *path, BYTE mode, enum clmt_slot slot, FILINFO *fno)
+{
+    struct clmt_entry *e = &clmt_cache[slot];
+    FRESULT rc;
+
+    if ((rc = f_stat(path, fno)) != FR_OK) {
+        return rc;
+    }
+    if ((rc = f_open(fp, path, mode)) != FR_OK) {
+        return rc;
+    }
+
+    fp->cltbl = e->tbl;
+    if (e->valid && strcmp(e->path, path) == 0 && e->fsize == fno->fsize && e->fdate == fno->fdate
+        && e->ftime == fno->ftime) {
+        return FR_OK;
+    }
+
+    e->valid = false;
+    e->tbl[0] = CLMT_SIZE;
+    if (f_lseek(fp, CREATE_LINKMAP) != FR_OK) {
+        // Too fragmented for the table, follow the FAT chain
+        fp->cltbl = NULL;
+        return FR_OK;
+    }
+    strncpy(e->path, path, sizeof(e->path) - 1);
+    e->path[sizeof(e->path) - 1] = 0;
+    e->fsize = fno->fsize;
+    e->fdate = fno->fdate;
+    e->ftime = fno->ftime;
+    e->valid = true;
+    return FR_OK;
+}
+
+// Writing in place keeps the clusters, only the timestamp changes on close
+static void clmt_update(enum clmt_slot slot)
+{
+    struct clmt_entry *e = &clmt_cache[slot];
+    FILINFO fno;
+
+    if (e->valid && f_stat(e->path, &fno) == FR_OK && fno.fsize == e->fsize) {
+        e->fdate = fno.fdate;
+        e->ftime = fno.ftime;
+    } else {
+        e->valid = false;
+    }
+}
+
+// Save files keep their clusters from one save to the next. A file is allocated once
+// as a contiguous run, then its sectors are written directly when raw is allowed.
+static FRESULT open_save(FIL *fp, const char *path, FSIZE_t size, bool raw, enum clmt_slot slot, LBA_t *sector)
+{
+    FILINFO fno;
+    FRESULT rc;
+
+    *sector = 0;
+    bool reuse = open_mapped(fp, path, FA_WRITE | FA_OPEN_EXISTING, slot, &fno) == FR_OK;
+    if (reuse && f_size(fp) != size) {
+        f_close(fp);
+        reuse = false;
+    }
+    if (!reuse) {
+        clmt_cache[slot].valid = false;
+        if ((rc = f_open(fp, path, FA_WRITE | FA_CREATE_ALWAYS)) != FR_OK) {
+            return rc;
+        }
+        // Without a contiguous free run the file is written through FatFs
+        if (f_expand(fp, size, 1) != FR_OK) {
+            return FR_OK;
+        }
+        f_close(fp);
+        if ((rc = open_mapped(fp, path, FA_WRITE | FA_OPEN_EXISTING, slot, &fno)) != FR_OK) {
+            return rc;
+        }
+    }
+
+    // A single fragment link map is {size, length, start cluster, 0}
+    if (raw && fp->cltbl && fp->cltbl[0] == 4) {
+        FATFS *fs = fp->obj.fs;
+        *sector = fs->database + (LBA_t)fs->csize * (fp->cltbl[2] - 2);
+    }
+    return FR_OK;
+}
+
+static bool save_writer(const uint8_t *data, uint32_t size, void *arg)
+{
+    struct save_writer *writer = arg;
+
+    if (writer->sector == 0) {
+        return file_writer(data, size, writer->fp);
+    }
+    if (disk_write(writer->fp->obj.fs->pdrv, data, writer->sector, size / FF_MIN_SS) != RES_OK) {
+        return false;
+    }
+    writer->sector += size / FF_MIN_SS;
+    return true;
+}
+
 static bool file_reader(uint8_t *data, uint32_t size, void *arg)
 {
     FIL *fp = arg;
@@ -289,6 +590,69 @@ static bool file_reader(uint8_t *data, uint32_t size, void *arg)
     return f_read(fp, data, size, &br) == FR_OK && br == size;
 }
 
+// Sector aligned chunks inside one fragment of the link map are read with SDIO DMA
+// directly, the previous chunk is summed in the meantime
+static bool crc_file_reader(uint8_t *data, uint32_t size, void *arg)
+{
+    struct crc_reader *reader = arg;
+    FIL *fp = reader->fp;
+    FSIZE_t ofs = f_tell(fp);
+    uint32_t count = size / FF_MIN_SS;
+    uint32_t run = 0;
+    LBA_t sector = 0;
+    bool ok;
+
+    if (ofs % FF_MIN_SS == 0 && size % FF_MIN_SS == 0 && count > 0 && ofs + size <= f_size(fp)) {
+        sector = file_sector(fp, ofs, &run);
+        if (run < count) {
+            sector = 0; // The chunk runs into the next fragment
+        }
+    }
+
+    bool direct = sector != 0 && disk_read_begin(fp->obj.fs->pdrv, data, sector, count) == RES_OK;
+    crc_reader_flush(reader);
+    if (direct && disk_read_end(fp->obj.fs->pdrv) == RES_OK) {
+        ok = f_lseek(fp, ofs + size) == FR_OK;
+    } else {
+        // A failed direct read is repeated by f_read(), disk_read() retries it
+        // at the default speed after a CRC error
+        ok = file_reader(data, size, fp);
+    }
+    reader->pending = data;
+    reader->pending_size = size;
+    return ok;
+}
+
+static void crc_reader_flush(struct crc_reader *reader)
+{
+    if (reader->pending) {
+        reader->crc = crc32_update(reader->crc, reader->pending, reader->pending_size);
+        reader->pending = NULL;
+    }
+}
+
+// Sector of a file offset taken from the link map, 0 when the file has none.
+// run is set to the number of sectors left in that fragment
+static LBA_t file_sector(FIL *fp, FSIZE_t ofs, uint32_t *run)
+{
+    FATFS *fs = fp->obj.fs;
+
+    if (!fp->cltbl) {
+        return 0;
+    }
+    DWORD cl = ofs / FF_MIN_SS / fs->csize;
+    uint32_t sect = ofs / FF_MIN_SS % fs->csize;
+    // {length, start cluster} pairs terminated by 0
+    for (DWORD *tbl = fp->cltbl + 1; tbl[0] != 0; tbl += 2) {
+        if (cl < tbl[0]) {
+            *run = (tbl[0] - cl) * fs->csize - sect;
+            return fs->database + (LBA_t)fs->csize * (tbl[1] + cl - 2) + sect;
+        }
+        cl -= tbl[0];
+    }
+    return 0;
+}
+
 static bool file_writer(const uint8_t *data, uint32_t size, void *arg)
 {
     FIL *fp = arg;
@@ -296,12 +660,6 @@ static bool file_writer(const uint8_t *data, uint32_t size, void *arg)
     return f_write(fp, data, size, &bw) == FR_OK && bw == size;
 }
 
-static bool const_reader(uint8_t *data, uint32_t size, void *arg)
-{
-    memset(data, (int)(uintptr_t)arg, size);
-    return true;
-}
-
 static uint32_t exp_size(uint32_t size)
 {
     uint32_t exp = size >> 2U;
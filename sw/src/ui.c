@@ -25,18 +25,38 @@ enum ui_state {
 };
 
 static FATFS fs;
-static struct dirlist_entry screen_list[VISIBLE_ROWS];
+static struct dirlist_row screen_list[VISIBLE_ROWS];
 static uint8_t screen_list_cnt;
 static enum ui_state state;
 static uint8_t cursor_pos;
 static uint8_t ingame_cursor;
 static uint16_t dir_index;
+static bool loading; // Directory listing still settling in the background
+static bool redraw_pending; // Drawn at the start of the next frame
+static bool frame_parity;
 
 static void update_screen_list()
 {
     screen_list_cnt = dirlist_select(dir_index, VISIBLE_ROWS, screen_list);
 }
 
+// A single step scroll keeps the rows on screen and fetches only the exposed one
+static void scroll_screen_list(uint16_t prev_dir_index)
+{
+    if (screen_list_cnt == VISIBLE_ROWS && dir_index == prev_dir_index + 1) {
+        memmove(&screen_list[0], &screen_list[1], (VISIBLE_ROWS - 1) * sizeof(*screen_list));
+        if (dirlist_select(dir_index + VISIBLE_ROWS - 1, 1, &screen_list[VISIBLE_ROWS - 1]) == 1) {
+            return;
+        }
+    } else if (screen_list_cnt == VISIBLE_ROWS && dir_index + 1 == prev_dir_index) {
+        memmove(&screen_list[1], &screen_list[0], (VISIBLE_ROWS - 1) * sizeof(*screen_list));
+        if (dirlist_select(dir_index, 1, &screen_list[0]) == 1) {
+            return;
+        }
+    }
+    update_screen_list();
+}
+
 static inline bool launcher_active()
 {
     return (fpga_api_ev_reg() & (1U << 8)) != 0;
@@ -45,8 +65,19 @@ static inline bool console_reset()
 {
     return (fpga_api_ev_reg() & (1U << 9)) != 0;
 }
+// Flips on every launcher vblank
+static inline bool frame_toggle()
+{
+    return (fpga_api_ev_reg() & (1U << 11)) != 0;
+}
+static inline void request_redraw()
+{
+    redraw_pending = true;
+}
 static void show_message(const char *msg);
 static void redraw_screen();
+static void list_dir();
+static void poll_dir();
 static void process_input(uint8_t pressed, uint8_t current);
 
 void ui_init()
@@ -77,7 +108,7 @@ void ui_poll()
             rom_save_battery();
             state = UI_STATE_PAUSE;
             ingame_cursor = 0;
-            redraw_screen();
+            request_redraw();
         }
         break;
     case UI_STATE_GAME:
@@ -86,6 +117,11 @@ void ui_poll()
             state = UI_STATE_RESET;
         }*/
         break;
+    case UI_STATE_MENU:
+        if (loading) {
+            poll_dir();
+        }
+        break;
     default:
     }
 
@@ -94,6 +130,17 @@ void ui_poll()
     if (pressed || current) {
         process_input(pressed, current);
     }
+
+    // Changes made during a frame are drawn once, right after the next vblank starts,
+    // so the buffer flip lands before the frame is scanned out
+    bool parity = frame_toggle();
+    if (parity != frame_parity) {
+        frame_parity = parity;
+        if (redraw_pending) {
+            redraw_pending = false;
+            redraw_screen();
+        }
+    }
 }
 
 bool ui_is_active()
@@ -106,6 +153,7 @@ static void show_message(const char *msg)
     if (!launcher_active()) {
         return;
     }
+    redraw_pending = false; // Shown right away, it may precede a long blocking operation
 
     uint16_t len = strlen(msg);
     uint16_t w_chars = len + 2;
@@ -134,14 +182,15 @@ static void draw_main_menu()
         return;
     }
 
-    gfx_clear();
+    // Plain text, drawn in the launcher text mode
+    gfx_text_clear();
     for (uint8_t i = 0; i < cnt; i++) {
         if (i == cursor_pos) {
-            gfx_fill_rect(FONT_WIDTH, (i + 2) * FONT_WIDTH, (COLS - 2) * FONT_WIDTH, FONT_WIDTH, 3);
+            gfx_text_bar(1, i + 2, COLS - 2);
         }
-        gfx_text(FONT_WIDTH, (i + 2) * FONT_WIDTH, screen_list[i].name, COLS - 2, screen_list[i].is_dir ? 2 : 1);
+        gfx_text_put(1, i + 2, screen_list[i].name, COLS - 2, screen_list[i].is_dir ? 2 : 1);
     }
-    gfx_refresh();
+    gfx_text_refresh();
 }
 
 static void draw_pause_menu()
@@ -203,10 +252,8 @@ void sd_callback(bool present)
             show_message("Open dir error");
             return;
         }
-        dir_index = 0;
-        cursor_pos = 0;
-        update_screen_list();
-        redraw_screen();
+        show_message("Reading directory...");
+        list_dir();
     } else {
         f_unmount("/SD");
         show_message("No SD card");
@@ -247,20 +294,21 @@ static void menu_control(uint8_t buttons)
             cursor_pos = dirlist_size() - dir_index - 1;
         }
     } else if (buttons & BUTTON_A) {
-        struct dirlist_entry *entry = &screen_list[cursor_pos];
-        if (entry->is_dir) {
+        struct dirlist_entry entry;
+        if (cursor_pos >= screen_list_cnt || dirlist_get(dir_index + cursor_pos, &entry) != 0) {
+            return; // Nothing listed yet
+        }
+        if (entry.is_dir) {
             show_message("Reading directory...");
 
-            if (dirlist_push(entry->name) != 0) {
+            if (dirlist_push(entry.name) != 0) {
                 show_message("Open dir error");
                 return;
             }
-            dir_index = 0;
-            cursor_pos = 0;
-            update_screen_list();
-            prev_dir_index = dir_index;
+            list_dir();
+            return;
         } else {
-            char *full_path = dirlist_file_path(entry);
+            char *full_path = dirlist_file_path(&entry);
             if (full_path == NULL) {
                 show_message("Memory error");
                 return;
@@ -280,18 +328,44 @@ static void menu_control(uint8_t buttons)
         if (dirlist_pop() != 0) {
             return;
         }
-        dir_index = 0;
-        cursor_pos = 0;
-        update_screen_list();
-        prev_dir_index = dir_index;
+        list_dir();
+        return;
     } else {
         return;
     }
 
     if (dir_index != prev_dir_index) {
+        scroll_screen_list(prev_dir_index);
+        gfx_text_scroll(dir_index - prev_dir_index);
+    }
+    request_redraw();
+}
+
+// The listing fills in from ui_poll(), input stays live meanwhile
+static void list_dir()
+{
+    dir_index = 0;
+    cursor_pos = 0;
+    screen_list_cnt = 0;
+    loading = true;
+}
+
+static void poll_dir()
+{
+    uint16_t prev_size = dirlist_size();
+    int r = dirlist_poll();
+    if (r < 0) {
+        loading = false;
+        show_message("Open dir error");
+        return;
+    }
+    loading = r > 0;
+
+    // Redraw only when entries settled inside the visible page
+    if ((dirlist_size() != prev_size || !loading) && prev_size < dir_index + VISIBLE_ROWS) {
         update_screen_list();
+        request_redraw();
     }
-    redraw_screen();
 }
 
 static void pause_control(uint8_t buttons)
@@ -326,7 +400,7 @@ static void pause_control(uint8_t buttons)
     } else {
         return;
     }
-    redraw_screen();
+    request_redraw();
 }
 
 static void process_input(uint8_t pressed, uint8_t current)